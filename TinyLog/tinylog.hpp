@@ -5,7 +5,7 @@
 //  Levels: trace, debug, info, warn, error, critical, off
 //  Sinks: console (colored), file (with size-based rotation)
 //  Thread-safe (mutex). Optional async mode via TINYLOG_ASYNC
-//  Structured log fields via stream-like API
+//  Structured key/value fields: kv("key", value), stored typed
 //  Compile-time level filter via TINYLOG_LEVEL
 //  Source location (file:line:function)
 //  Timestamps (UTC or local). Thread id.
@@ -29,26 +29,81 @@
 //   }
 //
 // Compile-time filtering (lowest level compiled in):
-//   #define TINYLOG_LEVEL tinylog::level::debug
+//   #define TINYLOG_LEVEL 1 // tinylog::level::debug (plain integer, used in #if)
 // Optional async mode:
 //   #define TINYLOG_ASYNC 1
+// Timestamps from the CPU counter (rdtsc / cntvct) instead of the system clock:
+//   #define TINYLOG_TSC 1
 
 #pragma once
+#include <algorithm>
 #include <atomic>
+#include <charconv>
 #include <chrono>
+#include <csignal>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <iterator>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <type_traits>
 #include <vector>
 #include <condition_variable>   // <-- needed for async queue
+#include <cerrno>
+#include <fcntl.h>
+#if defined(TINYLOG_ZLIB)
+#  include <zlib.h>      // gzip for rotated files (link -lz)
+#endif
+// SIMD for the JSON escaper (JsonSink); scalar fallback otherwise
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define TINYLOG_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define TINYLOG_NEON 1
+#endif
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+#ifndef TINYLOG_TSC
+#define TINYLOG_TSC 0
+#endif
+#if TINYLOG_TSC && !defined(_MSC_VER) && (defined(__x86_64__) || defined(__i386__))
+#  include <cpuid.h>
+#  include <x86intrin.h>
+#endif
+#if defined(_WIN32)
+#  include <io.h>
+#  include <share.h>
+#  include <sys/stat.h>
+#else
+#  include <climits>       // PIPE_BUF
+#  include <poll.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+#if defined(__linux__)
+#  include <pthread.h>     // worker CPU affinity
+#  include <sched.h>
+#endif
 #ifdef __has_include
 #  if __has_include(<filesystem>)
 #    include <filesystem>
@@ -69,183 +124,2666 @@ namespace tinylog {
         enum value : int { trace = 0, debug, info, warn, error, critical, off };
     };
 
-#ifndef TINYLOG_LEVEL
-#define TINYLOG_LEVEL tinylog::level::trace
+#ifndef TINYLOG_LEVEL
+#define TINYLOG_LEVEL 0 // tinylog::level::trace
+#endif
+
+    // Helprs (FUCKY)
+    inline unsigned tl_ctz32(unsigned v) {   // v != 0
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long i; _BitScanForward(&i, v); return (unsigned)i;
+#else
+        return (unsigned)__builtin_ctz(v);
+#endif
+    }
+    inline const char* level_name(int lv) {
+        switch (lv) {
+        case level::trace: return "TRACE";
+        case level::debug: return "DEBUG";
+        case level::info: return "INFO";
+        case level::warn: return "WARN";
+        case level::error: return "ERROR";
+        case level::critical: return "CRIT";
+        default: return "OFF";
+        }
+    }
+
+    inline uint64_t now_ns() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    // One clock read gives both LogMessage::ts_ns and ::wall
+    inline uint64_t wall_ns() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+#if TINYLOG_TSC
+    // Wall-clock ns from the CPU counter: one counter read and a multiply per message.
+    // Calibrated against system_clock at startup (~1 ms) and re-anchored about once a second by
+    // whichever thread notices first; small drift is slewed out over the next second, steps
+    // over 1 ms (NTP step, suspend) are taken as is. Without an invariant TSC (x86) or on
+    // other CPUs it falls back to wall_ns().
+    class TscClock {
+        // ns = wall0 + (dt * mult) >> 32. seq is odd while publish() rewrites the slot.
+        struct Params { std::atomic<uint32_t> seq{ 0 }; std::atomic<uint64_t> tsc0{ 0 }, wall0{ 0 }, mult{ 0 }; };
+        struct Snap { uint64_t tsc0, wall0, mult; };
+        Params p_[2];
+        std::atomic<int> cur_{ 0 };
+        std::atomic<bool> busy_{ false };
+        uint64_t anchor_tsc_ = 0, anchor_wall_ = 0;   // first calibration point (busy_ held)
+        uint64_t period_ = 0;                          // ticks between re-anchors
+        bool ok_ = false;
+
+        static uint64_t ticks() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#elif defined(__aarch64__)
+            uint64_t v; asm volatile("mrs %0, cntvct_el0" : "=r"(v)); return v;
+#else
+            return 0;
+#endif
+        }
+        static bool invariant() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            int r[4]; __cpuid(r, 0x80000000);
+            if ((unsigned)r[0] < 0x80000007u) return false;
+            __cpuid(r, 0x80000007); return (r[3] >> 8) & 1;
+#elif defined(__x86_64__) || defined(__i386__)
+            unsigned a, b, c, d;
+            if (!__get_cpuid(0x80000007, &a, &b, &c, &d)) return false;
+            return (d >> 8) & 1;
+#elif defined(__aarch64__)
+            return true;
+#else
+            return false;
+#endif
+        }
+        static uint64_t scale(uint64_t dt, uint64_t mult) {
+            return (dt >> 32) * mult + (((dt & 0xffffffffull) * mult) >> 32);
+        }
+        static uint64_t convert(const Snap& s, uint64_t t) {
+            return s.wall0 + (t > s.tsc0 ? scale(t - s.tsc0, s.mult) : 0);
+        }
+        // Seqlock read of the current slot. The double buffer makes retries rare: a reader only
+        // races a writer that has published twice since it picked the slot. Release stores and
+        // acquire loads instead of fences (plain movs on x86): a reader that sees any new field
+        // also sees the odd seq stored before it.
+        Snap snap() const {
+            for (;;) {
+                const Params& p = p_[cur_.load(std::memory_order_acquire)];
+                uint32_t s0 = p.seq.load(std::memory_order_acquire);
+                Snap s{ p.tsc0.load(std::memory_order_acquire), p.wall0.load(std::memory_order_acquire), p.mult.load(std::memory_order_acquire) };
+                if (!(s0 & 1) && p.seq.load(std::memory_order_relaxed) == s0) return s;
+            }
+        }
+        void publish(uint64_t t, uint64_t w, double ns_per_tick) {
+            Params& p = p_[cur_.load(std::memory_order_relaxed) ^ 1];
+            uint32_t s0 = p.seq.load(std::memory_order_relaxed);
+            p.seq.store(s0 + 1, std::memory_order_relaxed);
+            p.tsc0.store(t, std::memory_order_release);
+            p.wall0.store(w, std::memory_order_release);
+            p.mult.store((uint64_t)(ns_per_tick * 4294967296.0), std::memory_order_release);
+            p.seq.store(s0 + 2, std::memory_order_release);
+            cur_.store((int)(&p - p_), std::memory_order_release);
+        }
+        // A (counter, wall) pair read back to back; false if a preemption split them.
+        static bool sample(uint64_t& t, uint64_t& w) {
+            for (int tries = 0; tries < 4; ++tries) {
+                uint64_t a = ticks(); w = wall_ns(); uint64_t b = ticks();
+                if (b - a < 10000) { t = a + (b - a) / 2; return true; }
+            }
+            return false;
+        }
+        void reanchor() {
+            uint64_t t, w;
+            if (!sample(t, w)) return;
+            double ns_per_tick = (double)(w - anchor_wall_) / (double)(t - anchor_tsc_);
+            uint64_t est = convert(snap(), t);
+            double err = (double)(int64_t)(w - est);
+            if (err > 1e6 || err < -1e6) { publish(t, w, ns_per_tick); return; }
+            // Continue from the current estimate and run `err` faster/slower over the next second.
+            publish(t, est, ns_per_tick * (1.0 + err / 1e9));
+        }
+
+        TscClock() {
+            if (!invariant()) return;
+            uint64_t w0, t0, w1, t1;
+            if (!sample(t0, w0)) return;
+            do { if (!sample(t1, w1)) return; } while (w1 - w0 < 1000000);
+            if (t1 <= t0) return;
+            double ns_per_tick = (double)(w1 - w0) / (double)(t1 - t0);
+            anchor_tsc_ = t0; anchor_wall_ = w0;
+            period_ = (uint64_t)(1e9 / ns_per_tick);
+            publish(t1, w1, ns_per_tick);
+            ok_ = true;
+        }
+    public:
+        static TscClock& instance() { static TscClock c; return c; }
+        bool available() const { return ok_; }
+
+        uint64_t now() {
+            if (!ok_) return wall_ns();
+            uint64_t t = ticks();
+            Snap s = snap();
+            if (t > s.tsc0 && t - s.tsc0 > period_ && !busy_.exchange(true, std::memory_order_acquire)) {
+                reanchor();
+                busy_.store(false, std::memory_order_release);
+                s = snap();
+            }
+            return convert(s, t);
+        }
+    };
+#endif
+
+    // Timestamp source for messages: wall_ns(), or the calibrated CPU counter with TINYLOG_TSC.
+    inline uint64_t log_time_ns() {
+#if TINYLOG_TSC
+        return TscClock::instance().now();
+#else
+        return wall_ns();
+#endif
+    }
+
+#ifndef TINYLOG_LINE_BYTES
+#define TINYLOG_LINE_BYTES 512
+#endif
+
+    // Append-only text buffer for the hot path. Lives on the stack; only lines longer than
+    // TINYLOG_LINE_BYTES spill to the heap. Numbers go through std::to_chars, so there is
+    // no locale and no stream state involved.
+    class FmtBuf {
+        char inline_[TINYLOG_LINE_BYTES];
+        std::unique_ptr<char[]> heap_;
+        char* p_ = inline_;
+        size_t n_ = 0, cap_ = TINYLOG_LINE_BYTES;
+
+        void grow(size_t need) {
+            size_t c = cap_ * 2; while (c < n_ + need) c *= 2;
+            std::unique_ptr<char[]> h(new char[c]);
+            std::memcpy(h.get(), p_, n_);
+            heap_ = std::move(h); p_ = heap_.get(); cap_ = c;
+        }
+        char* reserve(size_t n) { if (n_ + n > cap_) grow(n); return p_ + n_; }
+    public:
+        FmtBuf() = default;
+        FmtBuf(const FmtBuf&) = delete; FmtBuf& operator=(const FmtBuf&) = delete;
+
+        const char* data() const { return p_; }
+        size_t size() const { return n_; }
+        std::string_view view() const { return std::string_view(p_, n_); }
+        std::string str() const { return std::string(p_, n_); }
+        void clear() { n_ = 0; }
+
+        void append(const char* s, size_t n) { std::memcpy(reserve(n), s, n); n_ += n; }
+        void append(std::string_view s) { append(s.data(), s.size()); }
+        void append(const char* s) { append(s, std::strlen(s)); }
+        void push_back(char c) { *reserve(1) = c; ++n_; }
+
+        template<class I> void append_int(I v) {
+            char* b = reserve(24);
+            n_ = (size_t)(std::to_chars(b, b + 24, v).ptr - p_);
+        }
+        // Fixed notation, 6 decimals: the same text cat() always produced.
+        void append_double(double v) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+            for (size_t room = 64;; room *= 8) {
+                char* b = reserve(room);
+                auto r = std::to_chars(b, b + room, v, std::chars_format::fixed, 6);
+                if (r.ec == std::errc()) { n_ = (size_t)(r.ptr - p_); return; }
+            }
+#else
+            int k = std::snprintf(nullptr, 0, "%.6f", v);
+            char* b = reserve((size_t)k + 1); std::snprintf(b, (size_t)k + 1, "%.6f", v); n_ += (size_t)k;
+#endif
+        }
+
+        template<class T> void append_value(const T& v);
+        template<class T> FmtBuf& operator<<(const T& v) { append_value(v); return *this; }
+    };
+
+    // Same appending interface on a fixed array, for the crash path: never allocates, silently
+    // truncates at N bytes.
+    template<size_t N> class FixedBuf {
+        char b_[N];
+        size_t n_ = 0;
+    public:
+        const char* data() const { return b_; }
+        size_t size() const { return n_; }
+        bool full() const { return n_ == N; }
+        std::string_view view() const { return std::string_view(b_, n_); }
+        void clear() { n_ = 0; }
+
+        void append(const char* s, size_t n) { if (n > N - n_) n = N - n_; std::memcpy(b_ + n_, s, n); n_ += n; }
+        void append(std::string_view s) { append(s.data(), s.size()); }
+        void append(const char* s) { append(s, std::strlen(s)); }
+        void push_back(char c) { if (n_ < N) b_[n_++] = c; }
+        template<class I> void append_int(I v) { char t[24]; append(t, (size_t)(std::to_chars(t, t + sizeof(t), v).ptr - t)); }
+        // Appends '\n', overwriting the last byte if the buffer is full.
+        void end_line() { if (n_ == N) --n_; b_[n_++] = '\n'; }
+    };
+
+    // streambuf over a FmtBuf, so operator<< fallbacks for user types do not allocate.
+    class FmtStreamBuf : public std::streambuf {
+        FmtBuf* out_ = nullptr;
+    protected:
+        int_type overflow(int_type c) override {
+            if (out_ && c != traits_type::eof()) out_->push_back((char)c);
+            return traits_type::not_eof(c);
+        }
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            if (out_) out_->append(s, (size_t)n);
+            return n;
+        }
+    public:
+        FmtBuf* target(FmtBuf* b) { FmtBuf* prev = out_; out_ = b; return prev; }
+    };
+
+    // Runs v's operator<< into b through a per-thread stream (fixed, precision 6, like cat()).
+    template<class T> inline void append_streamed(FmtBuf& b, const T& v) {
+        struct Fallback { FmtStreamBuf sb; std::ostream os{ &sb }; };
+        static thread_local Fallback f;
+        FmtBuf* prev = f.sb.target(&b);
+        f.os.clear(); f.os.flags(std::ios::fixed); f.os.precision(6); f.os.width(0); f.os.fill(' ');
+        f.os << v;
+        f.sb.target(prev);
+    }
+
+    // Stream manipulators only make sense on a real ostream; calls using them take the cat() slow path.
+    template<class D> struct is_manip : std::integral_constant<bool,
+        std::is_same_v<D, std::ios_base& (*)(std::ios_base&)> ||
+        std::is_same_v<D, std::ostream& (*)(std::ostream&)> ||
+        std::is_same_v<D, decltype(std::setw(0))> || std::is_same_v<D, decltype(std::setprecision(0))> ||
+        std::is_same_v<D, decltype(std::setfill(' '))> || std::is_same_v<D, decltype(std::setbase(10))> ||
+        std::is_same_v<D, decltype(std::setiosflags(std::ios::fixed))> ||
+        std::is_same_v<D, decltype(std::resetiosflags(std::ios::fixed))>> {};
+    template<class... Ts> constexpr bool any_manip = (is_manip<std::decay_t<Ts>>::value || ...);
+
+    // Structured field: LOG_INFO("req done", kv("latency_us", us), kv("user", id)).
+    // Kept typed in ArgPack (key + tagged value), so sinks can emit text, JSON or binary
+    // without re-parsing. In text it reads "req done latency_us=123 user=42".
+    // A Field refers to its value, so build it inside the log call.
+    template<class V> struct Field {
+        std::string_view key;
+        const V& value;
+    };
+    template<class V> inline Field<V> kv(std::string_view key, const V& value) { return Field<V>{ key, value }; }
+    template<class D> struct is_field : std::false_type {};
+    template<class V> struct is_field<Field<V>> : std::true_type {};
+    template<class V> inline std::ostream& operator<<(std::ostream& os, const Field<V>& f) {
+        if (os.tellp() > 0) os << ' ';
+        return os << f.key << '=' << f.value;
+    }
+
+    // Format strings for LOG_*F: "user {} took {}us" is split at compile time into literal
+    // segments ("user ", " took ", "us"), each NUL-terminated in static storage, and slots.
+    // {{ and }} are literal braces; any other brace, or a slot with a spec, is a build error.
+    // The segments are then logged interleaved with the arguments, as if written out by hand.
+    struct FmtLit { const char* s; uint32_t n; };   // one segment (a pointer into a FmtString)
+    inline std::ostream& operator<<(std::ostream& os, FmtLit l) { return os.write(l.s, (std::streamsize)l.n); }
+
+    template<size_t N> struct FmtString {
+        char text[N + N / 2 + 1]{};   // segments, each followed by a NUL
+        uint32_t off[N / 2 + 2]{}, len[N / 2 + 2]{};
+        size_t segs = 1;
+        bool ok = true;
+        constexpr FmtString(const char (&f)[N]) {
+            size_t o = 0;
+            for (size_t i = 0; i + 1 < N && ok; ++i) {
+                char c = f[i];
+                if ((c == '{' || c == '}') && i + 2 < N && f[i + 1] == c) { text[o++] = c; ++i; }
+                else if (c == '{' && i + 2 < N && f[i + 1] == '}') {
+                    len[segs - 1] = (uint32_t)(o - off[segs - 1]); text[o++] = 0;
+                    off[segs++] = (uint32_t)o; ++i;
+                }
+                else if (c == '{' || c == '}') ok = false;
+                else text[o++] = c;
+            }
+            len[segs - 1] = (uint32_t)(o - off[segs - 1]);
+        }
+        constexpr size_t slots() const { return segs - 1; }
+        constexpr FmtLit seg(size_t i) const { return FmtLit{ text + off[i], len[i] }; }
+    };
+    // sizeof(fmt_arity(args...)) == number of args; unevaluated, so it works on runtime values.
+    template<class... Ts> char (&fmt_arity(const Ts&...))[sizeof...(Ts)];
+
+    // char, signed char and unsigned char print as characters; their pointers (and arrays) as
+    // C strings, which operator<< would read later, so the text is copied at the call.
+    template<class C> constexpr bool is_char_v = std::is_same_v<C, char> || std::is_same_v<C, signed char> || std::is_same_v<C, unsigned char>;
+    template<class D> constexpr bool is_cstr_v = std::is_pointer_v<D> && is_char_v<std::remove_cv_t<std::remove_pointer_t<D>>>;
+    template<class T> constexpr bool is_char_array_v = std::is_array_v<T> && is_char_v<std::remove_cv_t<std::remove_extent_t<T>>>;
+
+    template<class T> inline void FmtBuf::append_value(const T& v) {
+        using D = std::decay_t<T>;
+        if constexpr (std::is_same_v<D, FmtLit>) {
+            append(v.s, v.n);
+        } else if constexpr (is_field<D>::value) {
+            if (n_) push_back(' ');
+            append(v.key); push_back('='); append_value(v.value);
+        } else if constexpr (is_char_array_v<T>) {
+            size_t n = 0; while (n < std::extent_v<T> && v[n]) ++n;
+            append((const char*)v, n);
+        } else if constexpr (is_cstr_v<D>) {
+            if (v) append((const char*)v); else append("(null)", 6);
+        } else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>) {
+            append(v.data(), v.size());
+        } else if constexpr (std::is_same_v<D, bool>) {
+            push_back(v ? '1' : '0');
+        } else if constexpr (is_char_v<D>) {
+            push_back((char)v);
+        } else if constexpr (std::is_integral_v<D>) {
+            append_int(v);
+        } else if constexpr (std::is_same_v<D, float> || std::is_same_v<D, double>) {
+            append_double(v);
+        } else {
+            append_streamed(*this, v);
+        }
+    }
+
+    inline std::tm to_tm(std::time_t tt, bool utc) {
+        std::tm tm{};
+#if defined(_WIN32)
+        if (utc) gmtime_s(&tm, &tt); else localtime_s(&tm, &tt);
+#else
+        if (utc) gmtime_r(&tt, &tm); else localtime_r(&tt, &tm);
+#endif
+        return tm;
+    }
+
+    // Sub-second digits appended after the seconds field
+    struct time_precision {
+        enum value : int { sec = 0, ms = 3, us = 6, ns = 9 };
+    };
+
+    // Appends "YYYY-MM-DD HH:MM:SS". The text for the last second seen is cached per thread
+    // (one entry each for UTC and local), so the tz conversion runs once per second, not per line.
+    template<class Buf> inline void append_time(Buf& b, std::time_t tt, bool utc) {
+        struct Cache { std::time_t sec = (std::time_t)-1; char txt[24]; size_t n = 0; };
+        static thread_local Cache cache[2];
+        Cache& c = cache[utc ? 1 : 0];
+        if (c.n == 0 || c.sec != tt) {
+            std::tm tm = to_tm(tt, utc);
+            int year = tm.tm_year + 1900;
+            char* s = c.txt; size_t n = 0;
+            auto d2 = [&](int v) { s[n++] = (char)('0' + v / 10 % 10); s[n++] = (char)('0' + v % 10); };
+            if (year >= 0 && year <= 9999) { d2(year / 100); d2(year % 100); }
+            else n = (size_t)(std::to_chars(s, s + 6, year).ptr - s);
+            s[n++] = '-'; d2(tm.tm_mon + 1); s[n++] = '-'; d2(tm.tm_mday);
+            s[n++] = ' '; d2(tm.tm_hour); s[n++] = ':'; d2(tm.tm_min); s[n++] = ':'; d2(tm.tm_sec);
+            c.n = n; c.sec = tt;
+        }
+        b.append(c.txt, c.n);
+    }
+
+    // Appends ".mmm", ".uuuuuu" or ".nnnnnnnnn" taken from a wall-clock nanosecond timestamp.
+    template<class Buf> inline void append_subsec(Buf& b, uint64_t ts_ns, int digits) {
+        if (digits <= 0) return;
+        if (digits > 9) digits = 9;
+        uint32_t frac = (uint32_t)(ts_ns % 1000000000ull);
+        for (int i = digits; i < 9; ++i) frac /= 10;
+        char s[10]; s[0] = '.';
+        for (int i = digits; i >= 1; --i) { s[i] = (char)('0' + frac % 10); frac /= 10; }
+        b.append(s, (size_t)digits + 1);
+    }
+
+    inline std::string fmt_time(std::time_t tt, bool utc) {
+        FmtBuf b; append_time(b, tt, utc); return b.str();
+    }
+
+    // concat variadic to string
+    inline void to_string_impl(std::ostringstream&) {}
+
+    template<class T, class... Rest>
+    inline void to_string_impl(std::ostringstream& oss, T&& t, Rest&&... rest) {
+        oss << std::forward<T>(t);
+        if constexpr (sizeof...(rest) > 0) to_string_impl(oss, std::forward<Rest>(rest)...);
+    }
+
+    template<class... Ts>
+    inline void cat_into(FmtBuf& b, Ts&&... ts) {
+        if constexpr (any_manip<Ts...>) {
+            std::ostringstream oss; oss.setf(std::ios::fixed); oss.precision(6);
+            to_string_impl(oss, std::forward<Ts>(ts)...); b.append(oss.str());
+        } else {
+            (b.append_value(ts), ...);
+        }
+    }
+
+    template<class... Ts>
+    inline std::string cat(Ts&&... ts) {
+        FmtBuf b; cat_into(b, std::forward<Ts>(ts)...); return b.str();
+    }
+
+#ifndef TINYLOG_ARG_BYTES
+#define TINYLOG_ARG_BYTES 192
+#endif
+
+    // Raw copy of log() arguments, so the async worker can do the formatting.
+    // Each argument is a tag byte plus payload:
+    //   bool/char             -> 1 byte
+    //   integers, floating    -> widened to int64/uint64/double
+    //   char*, std::string(_view), char[N] -> length + bytes (arrays up to the first NUL)
+    //   other trivially copyable types -> bytes + printer, operator<< runs on the worker
+    //   anything else         -> stringified on the caller thread
+    //   kv(key, v)            -> t_key + length + key bytes, then v as above
+    //   FmtLit                -> pointer only: static storage (empty ones take no bytes)
+    // capture() fails if the encoding does not fit; the caller then formats eagerly.
+    class ArgPack {
+    public:
+        enum tag : uint8_t { t_bool, t_char, t_i64, t_u64, t_f64, t_str, t_lit, t_obj, t_key };
+        using printer = void (*)(FmtBuf&, const void*);
+
+        // One decoded argument; which members are meaningful depends on tag.
+        struct ArgView {
+            uint8_t tag = t_str;
+            int64_t i = 0;          // t_bool (0/1), t_char, t_i64
+            uint64_t u = 0;         // t_u64
+            double d = 0;           // t_f64
+            std::string_view s;     // t_str, t_lit
+            printer pr = nullptr;   // t_obj
+            const void* obj = nullptr;
+            std::string_view key;   // set if the value came from kv()
+        };
+
+        // Appends one argument exactly as cat() would print it ("key=value" for fields).
+        static void render_arg(FmtBuf& out, const ArgView& a) {
+            if (!a.key.empty()) { if (out.size()) out.push_back(' '); out.append(a.key); out.push_back('='); }
+            render_value(out, a);
+        }
+        // The value alone, without a field's key.
+        static void render_value(FmtBuf& out, const ArgView& a) {
+            switch (a.tag) {
+            case t_bool: out.push_back(a.i ? '1' : '0'); break;
+            case t_char: out.push_back((char)a.i); break;
+            case t_i64: out.append_int(a.i); break;
+            case t_u64: out.append_int(a.u); break;
+            case t_f64: out.append_double(a.d); break;
+            case t_str: case t_lit: out.append(a.s); break;
+            case t_obj: a.pr(out, a.obj); break;
+            default: break;
+            }
+        }
+    private:
+        unsigned char buf_[TINYLOG_ARG_BYTES];
+        uint16_t used_ = 0;
+
+        bool room(size_t n) const { return used_ + n <= sizeof(buf_); }
+        bool put_raw(const void* p, size_t n) {
+            if (!room(n)) return false;
+            std::memcpy(buf_ + used_, p, n); used_ = (uint16_t)(used_ + n); return true;
+        }
+        template<class V> bool put_tagged(tag t, const V& v) {
+            if (!room(1 + sizeof(V))) return false;
+            buf_[used_++] = t; return put_raw(&v, sizeof(V));
+        }
+        bool put_str(const char* p, size_t n) {
+            if (!room(1 + sizeof(uint32_t) + n)) return false;
+            uint32_t len = (uint32_t)n;
+            buf_[used_++] = t_str; put_raw(&len, sizeof(len)); return put_raw(p, n);
+        }
+
+        template<class T> static void print_obj(FmtBuf& b, const void* p) {
+            alignas(T) unsigned char tmp[sizeof(T)];
+            std::memcpy(tmp, p, sizeof(T));
+            b.append_value(*reinterpret_cast<const T*>(tmp));
+        }
+
+        template<class T> bool put(T&& v) {
+            using R = std::remove_reference_t<T>;
+            using D = std::decay_t<T>;
+            if constexpr (std::is_same_v<D, FmtLit>) {
+                return v.n == 0 || put_tagged(t_lit, v.s);
+            } else if constexpr (is_field<D>::value) {
+                uint16_t n = (uint16_t)std::min<size_t>(v.key.size(), 0xffff);
+                if (!room(1 + sizeof(n) + n)) return false;
+                buf_[used_++] = t_key; put_raw(&n, sizeof(n)); put_raw(v.key.data(), n);
+                return put(v.value);
+            } else if constexpr (is_char_array_v<R>) {
+                // Copied even when const: a local array is indistinguishable from a literal.
+                size_t n = 0; while (n < std::extent_v<R> && v[n]) ++n;
+                return put_str((const char*)v, n);
+            } else if constexpr (is_cstr_v<D>) {
+                return v ? put_str((const char*)v, std::strlen((const char*)v)) : put_str("(null)", 6);
+            } else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>) {
+                return put_str(v.data(), v.size());
+            } else if constexpr (std::is_same_v<D, bool>) {
+                unsigned char b = v ? 1 : 0; return put_tagged(t_bool, b);
+            } else if constexpr (is_char_v<D>) {
+                char c = (char)v; return put_tagged(t_char, c);
+            } else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>) {
+                int64_t i = v; return put_tagged(t_i64, i);
+            } else if constexpr (std::is_integral_v<D>) {
+                uint64_t u = v; return put_tagged(t_u64, u);
+            } else if constexpr (std::is_same_v<D, float> || std::is_same_v<D, double>) {
+                double d = v; return put_tagged(t_f64, d);
+            } else if constexpr (std::is_trivially_copyable_v<D>) {
+                if (!room(1 + sizeof(printer) + sizeof(uint16_t) + sizeof(D))) return false;
+                printer pr = &print_obj<D>; uint16_t n = (uint16_t)sizeof(D); D copy = v;
+                buf_[used_++] = t_obj; put_raw(&pr, sizeof(pr)); put_raw(&n, sizeof(n)); return put_raw(&copy, sizeof(D));
+            } else {
+                FmtBuf b; b.append_value(v);
+                return put_str(b.data(), b.size());
+            }
+        }
+    public:
+        ArgPack() = default;
+        ArgPack(const ArgPack& o) : used_(o.used_) { std::memcpy(buf_, o.buf_, used_); }
+        ArgPack& operator=(const ArgPack& o) { used_ = o.used_; std::memcpy(buf_, o.buf_, used_); return *this; }
+
+        bool empty() const { return used_ == 0; }
+        void clear() { used_ = 0; }
+        const unsigned char* data() const { return buf_; }
+        size_t size() const { return used_; }
+
+        // Arguments are only read, never moved from, so the caller may still use them on failure.
+        template<class... Ts> bool capture(Ts&&... ts) {
+            used_ = 0;
+            if constexpr (any_manip<Ts...>) return false;
+            if ((put(std::forward<Ts>(ts)) && ...)) return true;
+            used_ = 0; return false;
+        }
+
+        // Calls f(const ArgView&) for every captured argument, in order.
+        template<class F> void for_each(F&& f) const {
+            size_t i = 0;
+            auto rd = [&](void* dst, size_t n) { std::memcpy(dst, buf_ + i, n); i += n; };
+            std::string_view key;
+            while (i < used_) {
+                ArgView a; a.tag = buf_[i++];
+                switch (a.tag) {
+                case t_key: { uint16_t n; rd(&n, 2); key = std::string_view((const char*)buf_ + i, n); i += n; continue; }
+                case t_bool: { unsigned char b; rd(&b, 1); a.i = b; break; }
+                case t_char: { char c; rd(&c, 1); a.i = c; break; }
+                case t_i64: rd(&a.i, 8); break;
+                case t_u64: rd(&a.u, 8); break;
+                case t_f64: rd(&a.d, 8); break;
+                case t_str: { uint32_t n; rd(&n, 4); a.s = std::string_view((const char*)buf_ + i, n); i += n; break; }
+                case t_lit: { const char* p; rd(&p, sizeof(p)); a.s = p; break; }
+                case t_obj: { uint16_t n; rd(&a.pr, sizeof(a.pr)); rd(&n, 2); a.obj = buf_ + i; i += n; break; }
+                default: return;
+                }
+                a.key = key; key = {};
+                f(a);
+            }
+        }
+
+        // Same output as cat() would have produced for the captured arguments.
+        void render(FmtBuf& out) const { for_each([&](const ArgView& a) { render_arg(out, a); }); }
+        std::string render() const { FmtBuf b; render(b); return b.str(); }
+    };
+
+    // File name without directories, evaluated at compile time for __FILE__
+    constexpr const char* basename_of(const char* path) {
+        const char* b = path;
+        for (const char* p = path; *p; ++p) if (*p == '/' || *p == '\\') b = p + 1;
+        return b;
+    }
+
+    // Source location of one LOG_* statement. LOG_AT emits it as a static constexpr,
+    // so messages carry a single pointer and nothing is parsed at runtime.
+    struct CallSite {
+        const char* file;
+        const char* base;   // basename_of(file)
+        const char* func;
+        int line;
+        int level;
+    };
+
+    // Runtime on/off state of one LOG_* statement, a function-local static next to its CallSite
+    // (constant-initialized: no guard). unknown sites register with the Logger on first use;
+    // after that a disabled site costs one relaxed load and a branch. The state is cached for
+    // the first Logger that checks it (owner); other loggers evaluate the site uncached.
+    struct site_state { enum value : unsigned char { unknown = 0, on, off }; };
+    struct SiteState {
+        std::atomic<unsigned char> v{ site_state::unknown };
+        std::atomic<const void*> owner{ nullptr };
+    };
+    // LOG_AT_LEVEL's static: the interned site for each level, looked up once per call site.
+    struct LevelSites {
+        std::atomic<const CallSite*> site[level::off]{};
+        SiteState state[level::off];
+    };
+
+    // Per-site state behind LOG_*_EVERY_N and LOG_*_RATE; a constant-initialized static like
+    // SiteState. The rate limit is a token bucket holding one second's worth of messages,
+    // kept as a single "theoretical arrival time" (GCRA) so admission is one CAS.
+    struct SiteLimiter {
+        std::atomic<uint64_t> calls{ 0 };       // EVERY_N
+        std::atomic<uint64_t> tat_ns{ 0 };      // RATE: when the bucket is next full-minus-one
+        std::atomic<uint64_t> suppressed{ 0 };  // dropped by the rate limit, not yet reported
+        std::atomic<uint64_t> last_hash{ 0 };   // args of the last message let through
+        std::atomic<uint64_t> repeats{ 0 };     // identical messages folded, not yet reported
+        std::atomic<bool> tracked{ false };     // known to Logger::report_suppressed()
+
+        bool every_n(uint64_t n) { return calls.fetch_add(1, std::memory_order_relaxed) % n == 0; }  // n from sample_period()
+        bool rate(double per_sec, uint64_t now) {
+            uint64_t interval = (uint64_t)(1e9 / (per_sec > 0 ? per_sec : 1e-9));
+            uint64_t tau = interval < 1000000000ull ? 1000000000ull - interval : 0;  // burst of per_sec
+            uint64_t tat = tat_ns.load(std::memory_order_relaxed);
+            for (;;) {
+                if (tat > now + tau) return false;
+                if (tat_ns.compare_exchange_weak(tat, std::max(tat, now) + interval, std::memory_order_relaxed)) return true;
+            }
+        }
+    };
+
+    // Per-site duration histogram behind LOG_SCOPE_STATS; a constant-initialized static like
+    // SiteLimiter. Recording is a few relaxed atomics (min/max only CAS when they move);
+    // Logger::report_scope_stats() logs and resets the summaries.
+    struct ScopeStats {
+        static constexpr int buckets = 32;   // hist[i]: durations in [2^i, 2^(i+1)) ns
+        const CallSite* site;
+        const char* name;
+        SiteState* state;                    // the statement's on/off state, checked again when reporting
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sum_ns{ 0 };
+        std::atomic<uint64_t> min_ns{ ~0ull };
+        std::atomic<uint64_t> max_ns{ 0 };
+        std::atomic<uint64_t> hist[buckets]{};
+        std::atomic<bool> tracked{ false };   // registered with the Logger
+
+        void record(uint64_t ns) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum_ns.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t v = min_ns.load(std::memory_order_relaxed);
+            while (ns < v && !min_ns.compare_exchange_weak(v, ns, std::memory_order_relaxed)) {}
+            v = max_ns.load(std::memory_order_relaxed);
+            while (ns > v && !max_ns.compare_exchange_weak(v, ns, std::memory_order_relaxed)) {}
+            int b = 0; for (uint64_t x = ns; x > 1 && b < buckets - 1; x >>= 1) ++b;
+            hist[b].fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    // Sampling for LOG_*_SAMPLED: a per-thread xorshift64* generator, so the decision is a few
+    // multiplies with no shared state.
+    inline uint64_t sample_rand() {
+        thread_local uint64_t x = 0;
+        if (!x) x = (std::hash<std::thread::id>()(std::this_thread::get_id()) ^ now_ns()) | 1;
+        x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+        return x * 2685821657736338717ull;
+    }
+    // True with probability p, clamped to 0..1 (NaN: never). With a constant p the threshold
+    // folds at compile time.
+    inline bool sample(double p) {
+        if (!(p > 0.0)) return false;
+        return p >= 1.0 || (sample_rand() >> 11) < (uint64_t)(p * 9007199254740992.0);  // 2^53
+    }
+    // The n of LOG_*_EVERY_N / LOG_*_SAMPLE_N: 0 and negative values count as 1 (every execution).
+    template<class N> constexpr uint64_t sample_period(N n) { return n > 0 ? (uint64_t)n : 1; }
+
+    // Glob match: '*' any run, '?' any one character.
+    inline bool glob_match(const char* p, const char* s) {
+        const char* star = nullptr; const char* resume = nullptr;
+        while (*s) {
+            if (*p == '*') { star = p++; resume = s; }
+            else if (*p == '?' || *p == *s) { ++p; ++s; }
+            else if (star) { p = star + 1; s = ++resume; }
+            else return false;
+        }
+        while (*p == '*') ++p;
+        return !*p;
+    }
+
+#ifndef TINYLOG_TEXT_BYTES
+#define TINYLOG_TEXT_BYTES 256
+#endif
+
+    // Spill buffers for MsgText, recycled per thread. A buffer always returns to the free list of
+    // the thread that allocated it, even when another thread (the async worker) releases it, so
+    // the allocator never sees a cross-thread free. Foreign releases go on a lock-free stack the
+    // owner collects when its own list runs dry. The pool outlives its thread until every buffer
+    // it handed out has come back.
+    class TextPool {
+    public:
+        struct Buf {
+            Buf* next;
+            TextPool* owner;
+            size_t cap;
+            char* data() { return reinterpret_cast<char*>(this + 1); }
+        };
+
+        static Buf* acquire(size_t n) { return local().take(n); }
+        static void release(Buf* b) { b->owner->give_back(b); }
+
+    private:
+        static constexpr size_t keep_ = 64;   // buffers kept per thread; the rest are freed
+        Buf* free_ = nullptr;
+        size_t free_count_ = 0;
+        std::atomic<Buf*> returned_{ nullptr };
+        std::atomic<long> refs_{ 1 };        // the owning thread + buffers handed out
+
+        struct Holder { TextPool* p = new TextPool(); ~Holder() { current() = nullptr; p->thread_exit(); } };
+        static TextPool*& current() { static thread_local TextPool* c = nullptr; return c; }
+        static TextPool& local() { static thread_local Holder h; current() = h.p; return *h.p; }
+
+        static void free_list(Buf* l) { while (l) { Buf* n = l->next; ::operator delete(l); l = n; } }
+        void keep(Buf* b) {
+            if (free_count_ >= keep_) { ::operator delete(b); return; }
+            b->next = free_; free_ = b; ++free_count_;
+        }
+        void reclaim() {
+            for (Buf* l = returned_.exchange(nullptr, std::memory_order_acquire); l;) { Buf* n = l->next; keep(l); l = n; }
+        }
+        Buf* take(size_t n) {
+            if (!free_) reclaim();
+            for (Buf** pp = &free_; *pp; pp = &(*pp)->next) {
+                if ((*pp)->cap < n) continue;
+                Buf* b = *pp; *pp = b->next; --free_count_;
+                refs_.fetch_add(1, std::memory_order_relaxed);
+                return b;
+            }
+            size_t cap = 1024; while (cap < n) cap <<= 1;
+            Buf* b = static_cast<Buf*>(::operator new(sizeof(Buf) + cap));
+            b->next = nullptr; b->owner = this; b->cap = cap;
+            refs_.fetch_add(1, std::memory_order_relaxed);
+            return b;
+        }
+        void give_back(Buf* b) {
+            if (current() == this) keep(b);
+            else {
+                Buf* h = returned_.load(std::memory_order_relaxed);
+                do { b->next = h; } while (!returned_.compare_exchange_weak(h, b, std::memory_order_release, std::memory_order_relaxed));
+            }
+            unref();
+        }
+        void thread_exit() { reclaim(); free_list(free_); free_ = nullptr; free_count_ = 0; unref(); }
+        void unref() {
+            if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+            free_list(returned_.exchange(nullptr, std::memory_order_acquire)); free_list(free_);
+            delete this;
+        }
+    };
+
+    // Message text: up to TINYLOG_TEXT_BYTES inline, longer text in a pooled TextPool buffer.
+    class MsgText {
+        char inline_[TINYLOG_TEXT_BYTES];
+        uint32_t n_ = 0;
+        TextPool::Buf* spill_ = nullptr;
+
+        void drop_spill() { if (spill_) { TextPool::release(spill_); spill_ = nullptr; } }
+    public:
+        MsgText() = default;
+        MsgText(const MsgText& o) { assign(o.data(), o.size()); }
+        MsgText(MsgText&& o) noexcept : n_(o.n_), spill_(o.spill_) {
+            if (!spill_) std::memcpy(inline_, o.inline_, n_);
+            o.spill_ = nullptr; o.n_ = 0;
+        }
+        MsgText& operator=(const MsgText& o) { if (this != &o) assign(o.data(), o.size()); return *this; }
+        MsgText& operator=(MsgText&& o) noexcept {
+            if (this == &o) return *this;
+            drop_spill(); n_ = o.n_; spill_ = o.spill_;
+            if (!spill_) std::memcpy(inline_, o.inline_, n_);
+            o.spill_ = nullptr; o.n_ = 0;
+            return *this;
+        }
+        MsgText& operator=(std::string_view s) { assign(s.data(), s.size()); return *this; }
+        ~MsgText() { drop_spill(); }
+
+        void assign(const char* p, size_t n) {
+            if (n <= sizeof(inline_)) { drop_spill(); std::memcpy(inline_, p, n); }
+            else {
+                if (spill_ && spill_->cap < n) drop_spill();
+                if (!spill_) spill_ = TextPool::acquire(n);
+                std::memcpy(spill_->data(), p, n);
+            }
+            n_ = (uint32_t)n;
+        }
+        void clear() { drop_spill(); n_ = 0; }
+
+        const char* data() const { return spill_ ? spill_->data() : inline_; }
+        size_t size() const { return n_; }
+        bool empty() const { return n_ == 0; }
+        std::string_view view() const { return std::string_view(data(), n_); }
+        std::string str() const { return std::string(data(), n_); }
+        operator std::string_view() const { return view(); }
+        operator std::string() const { return str(); }   // for sinks written against std::string text
+    };
+    inline std::ostream& operator<<(std::ostream& os, const MsgText& t) { return os << t.view(); }
+
+    // Log Message
+    struct LogMessage {
+        int level;
+        uint64_t ts_ns;   // wall clock, ns since epoch (same sample as wall)
+        std::time_t wall; // wall clock seconds
+        std::thread::id tid;
+        const CallSite* site;
+        MsgText text;     // inline up to TINYLOG_TEXT_BYTES; use text.view() / text.str()
+        ArgPack args;     // raw arguments when formatting was deferred; text is rendered from them
+                          // before dispatch unless no sink needs text
+        // Plain line (no color, no newline) Logger rendered once for all line sinks of this
+        // dispatch, with line_utc/line_subsec. Empty otherwise; only valid inside write().
+        std::string_view line;
+        bool line_utc = false;
+        int line_subsec = 0;
+
+        void render_text() {
+            if (args.empty()) return;
+            FmtBuf b; args.render(b); text.assign(b.data(), b.size());
+        }
+    };
+
+    inline const char* level_color(int lv) {
+        switch (lv) {
+        case level::trace:    return "\033[90m";
+        case level::debug:    return "\033[36m";
+        case level::info:     return "\033[37m";
+        case level::warn:     return "\033[33m";
+        case level::error:    return "\033[31m";
+        case level::critical: return "\033[41;97m";
+        default: return "\033[0m";
+        }
+    }
+
+    // Thread ids only have operator<<; remember the last one formatted on this thread.
+    // The view stays valid until the next call with a different id on the same thread.
+    inline std::string_view tid_text(std::thread::id id) {
+        struct Cache { std::thread::id id; char txt[32]; size_t n = 0; };
+        static thread_local Cache c;
+        if (c.n == 0 || c.id != id) {
+            FmtBuf t; append_streamed(t, id);
+            c.n = t.size() < sizeof(c.txt) ? t.size() : sizeof(c.txt);
+            std::memcpy(c.txt, t.data(), c.n); c.id = id;
+        }
+        return std::string_view(c.txt, c.n);
+    }
+    inline void append_tid(FmtBuf& b, std::thread::id id) { b.append(tid_text(id)); }
+
+    // The line layout itself. Also used by the binary decoder, which only has the thread id as text.
+    template<class Buf> inline void format_line_parts(Buf& out, int lv, std::time_t wall, uint64_t ts_ns, std::string_view tid,
+                                  const CallSite& site, std::string_view text, bool utc, bool colorize, int subsec) {
+        // Example: LOC 2025-09-15 22:13:31 [DEBUG] (thread:1234) main.cpp:24 main | message...
+        if (colorize) out.append(level_color(lv));
+        out.append(utc ? "UTC " : "LOC "); append_time(out, wall, utc); append_subsec(out, ts_ns, subsec);
+        out.append(" ["); out.append(level_name(lv)); out.append("] (tid:"); out.append(tid); out.append(") ");
+        out.append(site.base); out.push_back(':'); out.append_int(site.line); out.push_back(' ');
+        out.append(site.func); out.append(" | "); out.append(text);
+        if (colorize) out.append("\033[0m");
+    }
+
+    // Pretty, unified formatter (used by both sinks)
+    // subsec: digits after the seconds (time_precision::*), taken from m.ts_ns.
+    inline void format_line(const LogMessage& m, bool utc, FmtBuf& out, bool colorize = false, int subsec = time_precision::sec) {
+        format_line_parts(out, m.level, m.wall, m.ts_ns, tid_text(m.tid), *m.site, m.text, utc, colorize, subsec);
+    }
+
+    inline std::string format_line(const LogMessage& m, bool utc, bool colorize = false, int subsec = time_precision::sec) {
+        FmtBuf b; format_line(m, utc, b, colorize, subsec); return b.str();
+    }
+
+    // m.line if it was rendered with these settings, else empty (the sink formats it itself).
+    inline std::string_view shared_line(const LogMessage& m, bool utc, int subsec) {
+        return (m.line_utc == utc && m.line_subsec == subsec) ? m.line : std::string_view();
+    }
+    // Plain line for a sink: the shared one when it fits, otherwise formatted here.
+    inline void append_line(FmtBuf& out, const LogMessage& m, bool utc, int subsec) {
+        std::string_view l = shared_line(m, utc, subsec);
+        if (!l.empty()) out.append(l); else format_line(m, utc, out, false, subsec);
+    }
+    // Crash-path thread id: its bytes as a number instead of operator<< (may allocate; the usual
+    // std libs print that same native handle).
+    inline std::string_view crash_tid(std::thread::id tid, char (&out)[24]) {
+        uint64_t id = 0;
+        if (sizeof(tid) <= sizeof(id)) std::memcpy(&id, &tid, sizeof(tid));
+        else id = std::hash<std::thread::id>{}(tid);
+        return std::string_view(out, (size_t)(std::to_chars(out, out + sizeof(out), id).ptr - out));
+    }
+    // Crash-path value: builtin types print as render_value() prints them. A user type's printer
+    // runs its operator<< through a stream, so it becomes "<?>".
+    template<class Buf> inline void crash_value(Buf& out, const ArgPack::ArgView& a) {
+        switch (a.tag) {
+        case ArgPack::t_bool: out.push_back(a.i ? '1' : '0'); break;
+        case ArgPack::t_char: out.push_back((char)a.i); break;
+        case ArgPack::t_i64: out.append_int(a.i); break;
+        case ArgPack::t_u64: out.append_int(a.u); break;
+        case ArgPack::t_f64: {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+            char t[64]; auto r = std::to_chars(t, t + sizeof(t), a.d, std::chars_format::fixed, 6);
+            if (r.ec == std::errc()) { out.append(t, (size_t)(r.ptr - t)); break; }
+#endif
+            out.append("<double>", 8); break;
+        }
+        case ArgPack::t_str: case ArgPack::t_lit: out.append(a.s); break;
+        case ArgPack::t_obj: out.append("<?>", 3); break;
+        default: break;
+        }
+    }
+
+    // Crash-path line: fixed stack buffers only, UTC (local time may take the tz lock), thread id
+    // and deferred args as above.
+    using CrashLine = FixedBuf<4096>;
+    inline void emergency_line(CrashLine& out, const LogMessage& m, int subsec) {
+        char tid[24];
+        CrashLine args; std::string_view text = m.text.view();
+        if (text.empty() && !m.args.empty()) {
+            m.args.for_each([&](const ArgPack::ArgView& a) {
+                if (!a.key.empty()) { if (args.size()) args.push_back(' '); args.append(a.key); args.push_back('='); }
+                crash_value(args, a);
+            });
+            text = args.view();
+        }
+        format_line_parts(out, m.level, m.wall, m.ts_ns, crash_tid(m.tid, tid), *m.site, text, true, false, subsec);
+        out.end_line();
+    }
+
+    // Contiguous run of messages handed to a sink in one call (std::span stand-in for C++17)
+    struct MessageSpan {
+        const LogMessage* ptr = nullptr;
+        size_t count = 0;
+        const LogMessage* begin() const { return ptr; }
+        const LogMessage* end() const { return ptr + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const LogMessage& operator[](size_t i) const { return ptr[i]; }
+    };
+
+    // Tells the Logger to recompute its thresholds and site states (defined after Logger).
+    void sink_levels_changed();
+
+    // Sink Interface
+#ifndef TINYLOG_CACHELINE
+#define TINYLOG_CACHELINE 64
+#endif
+
+    // Relaxed counter split over cache lines: hot-path increments from many threads don't
+    // contend on one line. value() sums the shards.
+    class ShardedCounter {
+        struct alignas(TINYLOG_CACHELINE) Shard { std::atomic<uint64_t> v{ 0 }; };
+        Shard s_[16];
+        static unsigned shard() {
+            static std::atomic<unsigned> next{ 0 };
+            static thread_local unsigned i = next.fetch_add(1, std::memory_order_relaxed) & 15;
+            return i;
+        }
+    public:
+        void add(uint64_t n = 1) { s_[shard()].v.fetch_add(n, std::memory_order_relaxed); }
+        uint64_t value() const {
+            uint64_t n = 0;
+            for (auto& x : s_) n += x.v.load(std::memory_order_relaxed);
+            return n;
+        }
+    };
+
+    // What a sink has done, read by Logger::stats(). Sinks count bytes and rotations; Logger
+    // times the write calls.
+    struct SinkCounters {
+        static constexpr int buckets = 32;   // latency[i]: write calls taking [2^i, 2^(i+1)) ns
+        std::atomic<uint64_t> bytes{ 0 };
+        std::atomic<uint64_t> rotations{ 0 };
+        std::atomic<uint64_t> rotate_ns{ 0 };   // time the writing thread spent rotating
+        std::atomic<uint64_t> dropped{ 0 };     // lines the sink could not store (e.g. no mmap segment)
+        std::atomic<uint64_t> latency[buckets]{};
+        std::atomic<uint64_t> latency_ns{ 0 };  // sum over the timed calls
+
+        void add(std::atomic<uint64_t>& c, uint64_t n) { c.fetch_add(n, std::memory_order_relaxed); }
+        void add_latency(uint64_t ns) {
+            add(latency_ns, ns);
+            int b = 0; while (ns > 1 && b < buckets - 1) { ns >>= 1; ++b; }
+            add(latency[b], 1);
+        }
+    };
+
+    class LogSink {
+        std::atomic<int> level_{ level::trace };
+        SinkCounters counters_;
+    public:
+        virtual ~LogSink() = default;
+        // Called from any logging thread (and the async worker) without a Logger-wide lock:
+        // sinks serialize their own state.
+        virtual void write(const LogMessage& m) = 0;
+        // Everything the async worker drained in one go. Override to turn N lines into one write.
+        virtual void write_batch(MessageSpan batch) { for (auto& m : batch) write(m); }
+        // False if the sink only reads LogMessage::args (e.g. BinaryFileSink): when no attached
+        // sink wants text, deferred messages are never rendered.
+        virtual bool wants_text() const { return true; }
+        // True if the sink writes format_line() output and can reuse LogMessage::line: with two or
+        // more such sinks, Logger renders each line once instead of once per sink.
+        virtual bool wants_line() const { return false; }
+        // Push out anything the sink is holding back (buffers, pending writes).
+        virtual void flush() {}
+        // Fatal-signal path (Logger::install_crash_handler): write out what is buffered, then
+        // lines that never reached the sink. Runs in a signal handler: plain write(2) only, no
+        // locks, no allocation.
+        virtual void emergency_flush() {}
+        virtual void emergency_write(const LogMessage& m) { (void)m; }
+
+        // Lowest level this sink receives (e.g. trace to file, warn+ to console). Messages below
+        // every sink's level are dropped before they are formatted.
+        void set_level(int lv) {
+            level_.store(lv, std::memory_order_relaxed);
+            sink_levels_changed();
+        }
+        int level() const { return level_.load(std::memory_order_relaxed); }
+        SinkCounters& counters() { return counters_; }
+        const SinkCounters& counters() const { return counters_; }
+        // What Logger::stats() reports for this sink; a wrapper reports the wrapped sink's.
+        virtual const SinkCounters& stats_counters() const { return counters_; }
+    };
+
+    // Plain file descriptor I/O, so sinks control exactly when a syscall happens.
+    inline int file_open_append(const std::string& path) {
+#if defined(_WIN32)
+        int fd = -1;
+        _sopen_s(&fd, path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE);
+        return fd;
+#else
+        return ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+    }
+    inline void file_close(int fd) {
+#if defined(_WIN32)
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+    // Writes everything, retrying on EINTR and short writes. Returns false on error.
+    inline bool file_write_all(int fd, const char* p, size_t n) {
+        while (n > 0) {
+#if defined(_WIN32)
+            int w = _write(fd, p, (unsigned)(n > 0x7fffffff ? 0x7fffffff : n));
+#else
+            ssize_t w = ::write(fd, p, n);
+#endif
+            if (w < 0) { if (errno == EINTR) continue; return false; }
+            p += w; n -= (size_t)w;
+        }
+        return true;
+    }
+
+    // Writes as much as the fd takes without blocking (waiting at most timeout_ms for room) and
+    // returns the byte count. Pipes and sockets are only written once poll() reports room, at
+    // most PIPE_BUF at a time, so a stalled reader never holds up the caller.
+    inline size_t fd_write_some(int fd, const char* p, size_t n, bool pipe, int timeout_ms = 0) {
+#if defined(_WIN32)
+        (void)pipe; (void)timeout_ms;
+        return file_write_all(fd, p, n) ? n : 0;
+#else
+        size_t done = 0;
+        while (done < n) {
+            size_t chunk = n - done;
+            if (pipe) {
+                pollfd pf{ fd, POLLOUT, 0 };
+                int r = ::poll(&pf, 1, timeout_ms);
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0 || !(pf.revents & POLLOUT)) break;
+                chunk = std::min<size_t>(chunk, PIPE_BUF);
+            }
+            ssize_t w = ::write(fd, p + done, chunk);
+            if (w < 0) { if (errno == EINTR) continue; break; }
+            done += (size_t)w;
+        }
+        return done;
+#endif
+    }
+    inline bool fd_is_pipe(int fd) {
+#if defined(_WIN32)
+        (void)fd; return false;
+#else
+        struct stat st;
+        return ::fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+#endif
+    }
+
+    // Console Sink (Colored)
+    // Default: every line goes through std::cout (std::cerr for stderr_level+) and is flushed.
+    // set_buffered() switches to a buffer written straight to fd 1/2, for when stdout is a pipe
+    // to a log collector and per-line flushing would stall the logging threads.
+    class ConsoleSink : public LogSink {
+        struct Out { int fd; bool pipe; std::string buf; };
+        std::mutex mtx_;   // keeps lines whole
+        bool use_color_;
+        bool utc_;
+        int subsec_;
+        int stderr_level_ = level::off;
+        bool buffered_ = false;
+        bool drop_ = true;
+        size_t flush_bytes_ = 64 * 1024;
+        std::chrono::milliseconds flush_interval_{ 200 };
+        int flush_level_ = level::error;
+        std::chrono::steady_clock::time_point oldest_{};   // when the oldest pending byte was buffered
+        Out out_[2] = { { 1, false, {} }, { 2, false, {} } };
+        std::atomic<uint64_t> dropped_{ 0 };
+        std::mutex timer_mtx_;   // guards tick_; never taken by the tick itself
+        uint64_t tick_ = 0;
+
+        template<class Buf> void put(Buf& b, const LogMessage& m) {
+            std::string_view l = shared_line(m, utc_, subsec_);
+            if (l.empty()) { FmtBuf f; format_line(m, utc_, f, use_color_, subsec_); b.append(f.data(), f.size()); }
+            else {
+                // Color is only a prefix/suffix around the shared plain line.
+                if (use_color_) b.append(level_color(m.level));
+                b.append(l.data(), l.size());
+                if (use_color_) b.append("\033[0m");
+            }
+            b.append("\n", 1);
+        }
+        std::ostream& stream(int lv) { return lv >= stderr_level_ ? std::cerr : std::cout; }
+
+        // Buffered mode (mtx_ held)
+        void drain(Out& o, int timeout_ms = 0) {
+            if (o.buf.empty()) return;
+            size_t n = o.buf.size();
+            if (!drop_) file_write_all(o.fd, o.buf.data(), n);
+            else n = fd_write_some(o.fd, o.buf.data(), n, o.pipe, timeout_ms);
+            o.buf.erase(0, n);
+            counters().add(counters().bytes, n);
+        }
+        void drain_all() {
+            drain(out_[0]); drain(out_[1]);
+            oldest_ = std::chrono::steady_clock::now();   // a slow pipe's leftovers wait another interval
+        }
+        bool pending() const { return !out_[0].buf.empty() || !out_[1].buf.empty(); }
+        void add(const LogMessage& m) {
+            if (!pending()) oldest_ = std::chrono::steady_clock::now();
+            Out& o = out_[m.level >= stderr_level_];
+            // The reader keeps falling behind: drop rather than grow without bound.
+            if (drop_ && o.buf.size() >= 4 * flush_bytes_) {
+                drain(o);
+                if (o.buf.size() >= 4 * flush_bytes_) { dropped_.fetch_add(1, std::memory_order_relaxed); return; }
+            }
+            put(o.buf, m);
+        }
+        void maybe_flush(int lv) {
+            if (out_[0].buf.size() >= flush_bytes_ || out_[1].buf.size() >= flush_bytes_ || lv >= flush_level_ ||
+                std::chrono::steady_clock::now() - oldest_ >= flush_interval_)
+                drain_all();
+        }
+        // Maintenance tick: a quiet program's lines still go out after the interval.
+        void flush_if_due() {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (buffered_ && pending() && std::chrono::steady_clock::now() - oldest_ >= flush_interval_) drain_all();
+        }
+        void set_timer(bool on);   // after FileMaintenance
+    public:
+        explicit ConsoleSink(bool color = true, bool utc = false, int subsec = time_precision::sec) : use_color_(color), utc_(utc), subsec_(subsec) {}
+        ~ConsoleSink() override {
+            set_timer(false);
+            if (!buffered_) return;
+            // Give a slow reader a moment, but never hang the exit on it.
+            for (Out& o : out_)
+                for (int i = 0; i < 10 && !o.buf.empty(); ++i) drain(o, 100);
+        }
+
+        // Lines at lv and above go to stderr (level::off: all to stdout).
+        void set_stderr_level(int lv) { std::lock_guard<std::mutex> lk(mtx_); stderr_level_ = lv; }
+        // Buffered mode: written to fd 1/2 once `bytes` are pending, `interval` has passed since
+        // the oldest pending line (checked on each write and by the maintenance thread) or a
+        // flush_level+ line arrives. bytes = 0 drains and goes back to unbuffered writes.
+        // drop_when_full: when the pipe is full, keep at most 4 * bytes pending and drop new lines
+        // (counted by dropped()) instead of blocking the logging thread.
+        void set_buffered(size_t bytes = 64 * 1024, std::chrono::milliseconds interval = std::chrono::milliseconds(200),
+                          int flush_level = level::error, bool drop_when_full = true) {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                if (bytes == 0) { if (buffered_) drain_all(); buffered_ = false; }
+                else {
+                    std::cout.flush(); std::cerr.flush();   // keep earlier stream output in front
+                    buffered_ = true; drop_ = drop_when_full;
+                    flush_bytes_ = bytes; flush_interval_ = interval; flush_level_ = flush_level;
+                    for (Out& o : out_) { o.pipe = fd_is_pipe(o.fd); o.buf.reserve(flush_bytes_); }
+                }
+            }
+            set_timer(bytes != 0);   // not under mtx_: the tick takes it while the maintenance lock is held
+        }
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+        bool wants_line() const override { return true; }
+        void write(const LogMessage& m) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (buffered_) { add(m); maybe_flush(m.level); return; }
+            FmtBuf b; put(b, m);
+            std::ostream& os = stream(m.level);
+            os.write(b.data(), (std::streamsize)b.size());
+            // Force immediate flush so short-lived programs always show logs:
+            os << std::flush;
+            counters().add(counters().bytes, b.size());
+        }
+        void write_batch(MessageSpan batch) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (buffered_) {
+                int top = level::trace;
+                for (auto& m : batch) { add(m); top = std::max(top, m.level); }
+                maybe_flush(top);
+                return;
+            }
+            FmtBuf b[2];
+            for (auto& m : batch) put(b[m.level >= stderr_level_], m);
+            if (b[0].size()) std::cout.write(b[0].data(), (std::streamsize)b[0].size()) << std::flush;
+            if (b[1].size()) std::cerr.write(b[1].data(), (std::streamsize)b[1].size()) << std::flush;
+            counters().add(counters().bytes, b[0].size() + b[1].size());
+        }
+        void flush() override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (buffered_) drain_all();
+        }
+        void emergency_flush() override {
+            if (buffered_) for (Out& o : out_) if (!o.buf.empty()) file_write_all(o.fd, o.buf.data(), o.buf.size());
+        }
+        void emergency_write(const LogMessage& m) override {
+            CrashLine b; emergency_line(b, m, subsec_);
+            file_write_all(m.level >= stderr_level_ ? 2 : 1, b.data(), b.size());
+        }
+    };
+
+    // Compression for rotated files (done on the maintenance thread, see FileMaintenance).
+    // gzip needs zlib: build with -DTINYLOG_ZLIB and link -lz; without it files stay uncompressed.
+    struct compression { enum value : int { none = 0, gzip }; };
+
+    // rename() that also replaces an existing target on Windows.
+    inline void replace_file(const fs::path& from, const fs::path& to) {
+        std::error_code ec; fs::rename(from, to, ec);
+        if (ec) { fs::remove(to, ec); fs::rename(from, to, ec); }
+    }
+
+#if defined(TINYLOG_ZLIB)
+    // Writes src to dst as gzip. Returns false (and removes dst) on error.
+    inline bool gzip_file(const std::string& src, const std::string& dst) {
+        std::ifstream in(src, std::ios::binary);
+        if (!in) return false;
+        gzFile out = gzopen(dst.c_str(), "wb6");
+        if (!out) return false;
+        std::vector<char> chunk(64 * 1024);
+        bool ok = true;
+        while (ok && in) {
+            in.read(chunk.data(), (std::streamsize)chunk.size());
+            int n = (int)in.gcount();
+            if (n > 0 && gzwrite(out, chunk.data(), (unsigned)n) != n) ok = false;
+        }
+        if (gzclose(out) != Z_OK) ok = false;
+        if (!ok) { std::error_code ec; fs::remove(dst, ec); }
+        return ok;
+    }
+#endif
+
+    // Background thread that does the slow half of a rotation: closing the old fd, shifting
+    // path.1 -> path.2 ..., and compressing. Jobs run in order on one thread started on first use.
+    // Never destroyed, so sinks can post from static destructors; RotatingFile waits for idle.
+    // Between jobs it also runs the ticks (timed flushes of buffered files) every tick_period.
+    class FileMaintenance {
+    public:
+        struct Job {
+            int fd;              // old file's fd (closed here), or -1
+            std::string pending; // old file, already renamed away from path
+            std::string path;
+            int max_files;
+            int compress;
+        };
+
+        static FileMaintenance& instance() { static FileMaintenance* m = new FileMaintenance(); return *m; }
+
+        void post(Job j) {
+            { std::lock_guard<std::mutex> lk(mtx_); jobs_.push_back(std::move(j)); }
+            cv_.notify_one();
+        }
+        // Blocks until every posted job has finished.
+        void wait_idle() {
+            std::unique_lock<std::mutex> lk(mtx_);
+            idle_cv_.wait(lk, [&] { return jobs_.empty() && !busy_; });
+        }
+
+        static constexpr std::chrono::milliseconds tick_period{ 100 };
+        // f runs on the maintenance thread every tick_period until remove_tick(id) returns.
+        uint64_t add_tick(std::function<void()> f) {
+            uint64_t id;
+            {
+                std::lock_guard<std::mutex> lk(tick_mtx_);
+                id = ++tick_id_;
+                ticks_.emplace_back(id, std::move(f));
+                tick_count_.store(ticks_.size());
+            }
+            { std::lock_guard<std::mutex> lk(mtx_); }   // the loop is waiting or will see the count
+            cv_.notify_one();
+            return id;
+        }
+        void remove_tick(uint64_t id) {
+            std::lock_guard<std::mutex> lk(tick_mtx_);   // held while ticks run
+            for (auto it = ticks_.begin(); it != ticks_.end(); ++it)
+                if (it->first == id) { ticks_.erase(it); break; }
+            tick_count_.store(ticks_.size());
+        }
+
+    private:
+        std::mutex mtx_;
+        std::condition_variable cv_, idle_cv_;
+        std::deque<Job> jobs_;
+        bool busy_ = false;
+        std::mutex tick_mtx_;
+        std::vector<std::pair<uint64_t, std::function<void()>>> ticks_;
+        uint64_t tick_id_ = 0;
+        std::atomic<size_t> tick_count_{ 0 };
+
+        FileMaintenance() { std::thread([this] { loop(); }).detach(); }
+
+        void loop() {
+            std::unique_lock<std::mutex> lk(mtx_);
+            auto next_tick = std::chrono::steady_clock::now();
+            for (;;) {
+                if (tick_count_.load() == 0) cv_.wait(lk, [&] { return !jobs_.empty() || tick_count_.load() > 0; });
+                else cv_.wait_until(lk, next_tick, [&] { return !jobs_.empty(); });
+                if (!jobs_.empty()) {
+                    Job j = std::move(jobs_.front()); jobs_.pop_front();
+                    busy_ = true;
+                    lk.unlock();
+                    run(j);
+                    lk.lock();
+                    busy_ = false;
+                    if (jobs_.empty()) idle_cv_.notify_all();
+                    continue;
+                }
+                auto now = std::chrono::steady_clock::now();
+                if (now < next_tick) continue;
+                next_tick = now + tick_period;
+                lk.unlock();
+                { std::lock_guard<std::mutex> tl(tick_mtx_); for (auto& t : ticks_) t.second(); }
+                lk.lock();
+            }
+        }
+
+        static void run(const Job& j) {
+            if (j.fd >= 0) file_close(j.fd);
+            std::error_code ec;
+            if (j.max_files <= 1) { fs::remove(j.pending, ec); return; }
+            auto name = [&](int i, bool gz) { return j.path + "." + std::to_string(i) + (gz ? ".gz" : ""); };
+            fs::remove(name(j.max_files - 1, false), ec); fs::remove(name(j.max_files - 1, true), ec);
+            for (int i = j.max_files - 2; i >= 1; --i)
+                for (bool gz : { false, true })
+                    if (fs::exists(name(i, gz), ec)) replace_file(name(i, gz), name(i + 1, gz));
+            replace_file(j.pending, name(1, false));
+#if defined(TINYLOG_ZLIB)
+            if (j.compress == compression::gzip && gzip_file(name(1, false), name(1, true)))
+                fs::remove(name(1, false), ec);
+#endif
+        }
+    };
+
+    // Size-rotated append-only file with a user-space write buffer (FileSink, BinaryFileSink).
+    // Bytes are written with one write(2) once the buffer reaches flush_bytes, flush_interval has
+    // passed, or a message at flush_level (default: error) arrives. The current file size is
+    // tracked as bytes are written, so rotation needs no stat. Not thread-safe; sinks lock around it.
+    // Rotation itself is a rename + open on the caller; the backup cascade, close and compression
+    // are handed to FileMaintenance.
+    class RotatingFile {
+        std::string path_;
+        size_t max_bytes_;
+        int max_files_;
+        int compress_ = compression::none;
+        int fd_ = -1;
+        uintmax_t written_ = 0;   // bytes already in the current file
+        std::string buf_;         // bytes not yet written
+        size_t flush_bytes_ = 64 * 1024;
+        std::chrono::milliseconds flush_interval_{ 1000 };
+        int flush_level_ = level::error;
+        std::chrono::steady_clock::time_point last_flush_ = std::chrono::steady_clock::now();
+        bool posted_ = false;
+        SinkCounters* counters_ = nullptr;
+
+        void ensure_dir() {
+            std::error_code ec;
+            fs::create_directories(fs::path(path_).parent_path(), ec);
+        }
+        void open_file() {
+            if (fd_ >= 0) return;
+            ensure_dir();
+            fd_ = file_open_append(path_);
+            std::error_code ec; auto s = fs::file_size(path_, ec); written_ = ec ? 0 : s;
+        }
+        std::string pending_prefix() const { return fs::path(path_).filename().string() + ".rotating."; }
+        // Finishes rotations a previous process left half done (killed before maintenance ran).
+        void recover_pending() {
+            std::error_code ec;
+            fs::path dir = fs::path(path_).parent_path();
+            std::vector<std::string> left;
+            for (fs::directory_iterator it(dir.empty() ? fs::path(".") : dir, ec), end; !ec && it != end; it.increment(ec))
+                if (it->path().filename().string().rfind(pending_prefix(), 0) == 0) left.push_back(it->path().string());
+            std::sort(left.begin(), left.end());
+            for (auto& p : left) { FileMaintenance::instance().post({ -1, p, path_, max_files_, compress_ }); posted_ = true; }
+        }
+    public:
+        RotatingFile(std::string path, size_t max_bytes, int max_files)
+            : path_(std::move(path)), max_bytes_(max_bytes), max_files_(max_files) {
+            buf_.reserve(flush_bytes_ + TINYLOG_LINE_BYTES);
+            open_file();
+            if (max_bytes_) recover_pending();
+        }
+        ~RotatingFile() {
+            flush(); if (fd_ >= 0) file_close(fd_);
+            if (posted_) FileMaintenance::instance().wait_idle();
+        }
+        RotatingFile(const RotatingFile&) = delete; RotatingFile& operator=(const RotatingFile&) = delete;
+
+        const std::string& path() const { return path_; }
+        uintmax_t size() const { return written_ + buf_.size(); }
+
+        void set_flush_policy(size_t bytes, std::chrono::milliseconds interval, int flush_level) {
+            flush_bytes_ = bytes; flush_interval_ = interval; flush_level_ = flush_level;
+            buf_.reserve(flush_bytes_ + TINYLOG_LINE_BYTES);
+        }
+        // compression::none / gzip, for files rotated from now on.
+        void set_compression(int c) { compress_ = c; }
+        // Where bytes written and rotations are counted (the owning sink's counters).
+        void set_counters(SinkCounters* c) { counters_ = c; }
+
+        void append(const char* p, size_t n) { buf_.append(p, n); }
+        std::string& buffer() { return buf_; }
+        // Crash path: straight to the fd, the buffer is left as is.
+        void emergency_flush() { if (fd_ >= 0 && !buf_.empty()) file_write_all(fd_, buf_.data(), buf_.size()); }
+        void emergency_write(const char* p, size_t n) { if (fd_ >= 0) file_write_all(fd_, p, n); }
+
+        void flush() {
+            last_flush_ = std::chrono::steady_clock::now();
+            if (buf_.empty()) return;
+            if (fd_ < 0) open_file();
+            if (fd_ >= 0) file_write_all(fd_, buf_.data(), buf_.size());
+            written_ += buf_.size();
+            if (counters_) counters_->add(counters_->bytes, buf_.size());
+            buf_.clear();
+        }
+        void maybe_flush(int lv) {
+            if (buf_.size() >= flush_bytes_ || lv >= flush_level_ ||
+                std::chrono::steady_clock::now() - last_flush_ >= flush_interval_)
+                flush();
+        }
+        // Timer path (FlushTimer): buffered bytes older than the interval are written even if
+        // no further message arrives.
+        void flush_if_due() {
+            if (!buf_.empty() && std::chrono::steady_clock::now() - last_flush_ >= flush_interval_) flush();
+        }
+
+        // Rotates first if `incoming` more bytes would push the file past max_bytes.
+        // Returns true if a new, empty file was started.
+        bool rotate_if_needed(size_t incoming) {
+            if (max_bytes_ == 0) return false;
+            if (size() + incoming <= max_bytes_ || size() == 0) return false;
+            flush();
+            auto t0 = std::chrono::steady_clock::now();
+            std::string pending = path_ + ".rotating." + std::to_string(wall_ns());
+#if defined(_WIN32)
+            // An open file cannot be renamed here; close first.
+            if (fd_ >= 0) { file_close(fd_); fd_ = -1; }
+#endif
+            std::error_code ec; fs::rename(path_, pending, ec);
+            if (ec) { open_file(); return false; }
+            int old = fd_;
+            fd_ = file_open_append(path_); written_ = 0;
+            FileMaintenance::instance().post({ old, std::move(pending), path_, max_files_, compress_ });
+            posted_ = true;
+            if (counters_) {
+                counters_->add(counters_->rotations, 1);
+                counters_->add(counters_->rotate_ns, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+            }
+            return true;
+        }
+    };
+
+    inline void ConsoleSink::set_timer(bool on) {
+        std::lock_guard<std::mutex> lk(timer_mtx_);
+        if (on && !tick_) tick_ = FileMaintenance::instance().add_tick([this] { flush_if_due(); });
+        else if (!on && tick_) { FileMaintenance::instance().remove_tick(tick_); tick_ = 0; }
+    }
+
+    // Flushes a sink's RotatingFile from the maintenance thread once its flush interval has
+    // passed, so a quiet logger does not leave lines in the buffer. Declare it after the file
+    // and the mutex that guards it, so it is destroyed before them.
+    class FlushTimer {
+        uint64_t id_;
+    public:
+        FlushTimer(std::mutex& m, RotatingFile& f)
+            : id_(FileMaintenance::instance().add_tick([&m, &f] { std::lock_guard<std::mutex> lk(m); f.flush_if_due(); })) {}
+        ~FlushTimer() { FileMaintenance::instance().remove_tick(id_); }
+        FlushTimer(const FlushTimer&) = delete; FlushTimer& operator=(const FlushTimer&) = delete;
+    };
+
+    // File Sink w/ rotation (buffered, see RotatingFile)
+    class FileSink : public LogSink {
+        std::mutex mtx_;
+        RotatingFile file_;
+        FlushTimer timer_{ mtx_, file_ };
+        bool utc_;
+        int subsec_;
+
+        // Shared line goes straight into the file buffer; otherwise format it here.
+        void put(const LogMessage& m) {
+            std::string_view l = shared_line(m, utc_, subsec_);
+            FmtBuf b;
+            if (l.empty()) { format_line(m, utc_, b, false, subsec_); l = b.view(); }
+            file_.rotate_if_needed(l.size() + 1);
+            file_.append(l.data(), l.size());
+            file_.append("\n", 1);
+        }
+    public:
+        FileSink(std::string path, size_t max_bytes = 5 * 1024 * 1024, int max_files = 3, bool utc = false, int subsec = time_precision::sec)
+            : file_(std::move(path), max_bytes, max_files), utc_(utc), subsec_(subsec) {
+            file_.set_counters(&counters());
+        }
+
+        // bytes = 0 or interval = 0 write every line immediately.
+        void set_flush_policy(size_t bytes, std::chrono::milliseconds interval, int flush_level = level::error) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            file_.set_flush_policy(bytes, interval, flush_level);
+        }
+        void set_compression(int c) { std::lock_guard<std::mutex> lk(mtx_); file_.set_compression(c); }
+
+        bool wants_line() const override { return true; }
+        void write(const LogMessage& m) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            put(m);
+            file_.maybe_flush(m.level);
+        }
+        // One lock and at most one write(2) per batch (plus one per rotation it crosses).
+        void write_batch(MessageSpan batch) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            int top = level::trace;
+            for (auto& m : batch) {
+                put(m);
+                if (m.level > top) top = m.level;
+            }
+            file_.maybe_flush(top);
+        }
+
+        void flush() override { std::lock_guard<std::mutex> lk(mtx_); file_.flush(); }
+        void emergency_flush() override { file_.emergency_flush(); }
+        void emergency_write(const LogMessage& m) override {
+            CrashLine b; emergency_line(b, m, subsec_); file_.emergency_write(b.data(), b.size());
+        }
+    };
+
+    // JSON string escaping. Bytes that need it: '"', '\\' and control characters (< 0x20);
+    // everything else, UTF-8 included, is copied through. json_scan finds the next such byte
+    // 32 (AVX2) or 16 (SSE2/NEON) bytes at a time, so plain text is one bulk copy.
+    inline bool json_needs_escape(unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; }
+
+    inline const char* json_scan(const char* p, const char* end) {
+#if defined(__AVX2__)
+        const __m256i q8 = _mm256_set1_epi8('"'), bs8 = _mm256_set1_epi8('\\'), ctl8 = _mm256_set1_epi8(0x1f);
+        while (end - p >= 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, q8), _mm256_cmpeq_epi8(v, bs8)),
+                                        _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl8), ctl8));   // v <= 0x1f
+            unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+            if (bits) return p + tl_ctz32(bits);
+            p += 32;
+        }
+#endif
+#if defined(TINYLOG_SSE2)
+        const __m128i q = _mm_set1_epi8('"'), bs = _mm_set1_epi8('\\'), ctl = _mm_set1_epi8(0x1f);
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)),
+                                     _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+            unsigned bits = (unsigned)_mm_movemask_epi8(m);
+            if (bits) return p + tl_ctz32(bits);
+            p += 16;
+        }
+#elif defined(TINYLOG_NEON)
+        const uint8x16_t q = vdupq_n_u8('"'), bs = vdupq_n_u8('\\'), ctl = vdupq_n_u8(0x1f);
+        while (end - p >= 16) {
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+            uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, q), vceqq_u8(v, bs)), vcleq_u8(v, ctl));
+            // narrow 0xff/0x00 bytes to 4-bit nibbles: one 64-bit mask for 16 lanes
+            uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+            if (bits) return p + (__builtin_ctzll(bits) >> 2);
+            p += 16;
+        }
+#endif
+        while (p < end && !json_needs_escape((unsigned char)*p)) ++p;
+        return p;
+    }
+
+    // Appends s escaped for the inside of a JSON string.
+    template<class Buf> inline void json_escape(Buf& out, std::string_view s) {
+        const char* p = s.data(); const char* end = p + s.size();
+        for (;;) {
+            const char* e = json_scan(p, end);
+            out.append(p, (size_t)(e - p));
+            if (e == end) return;
+            unsigned char c = (unsigned char)*e;
+            switch (c) {
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '\f': out.append("\\f", 2); break;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+                out.append(u, 6);
+            }
+            }
+            p = e + 1;
+        }
+    }
+    template<class Buf> inline void json_string(Buf& out, std::string_view s) { out.push_back('"'); json_escape(out, s); out.push_back('"'); }
+
+    // Shortest round-trip form; NaN/inf are not JSON numbers and become null.
+    template<class Buf> inline void json_number(Buf& out, double v) {
+        if (!(v == v) || v - v != 0) { out.append("null", 4); return; }
+        char b[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        out.append(b, (size_t)(std::to_chars(b, b + sizeof(b), v).ptr - b));
+#else
+        int k = std::snprintf(b, sizeof(b), "%.17g", v); out.append(b, (size_t)k);
+#endif
+    }
+
+    // One JSON object per line (NDJSON), written like FileSink (buffered, rotated):
+    //   {"ts":"2025-09-15T22:41:31.042","level":"INFO","thread":"1403","file":"main.cpp","line":12,
+    //    "func":"main","msg":"req done","latency_us":123,"user":"bob"}
+    // kv() fields become members with their JSON type (numbers, true/false, strings); the other
+    // arguments make up "msg". ts ends in 'Z' when utc is set.
+    class JsonSink : public LogSink {
+        std::mutex mtx_;
+        RotatingFile file_;
+        FlushTimer timer_{ mtx_, file_ };
+        bool utc_;
+        int subsec_;
+    public:
+        JsonSink(std::string path, size_t max_bytes = 64 * 1024 * 1024, int max_files = 3, bool utc = false, int subsec = time_precision::ms)
+            : file_(std::move(path), max_bytes, max_files), utc_(utc), subsec_(subsec) {
+            file_.set_counters(&counters());
+        }
+
+        void set_flush_policy(size_t bytes, std::chrono::milliseconds interval, int flush_level = level::error) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            file_.set_flush_policy(bytes, interval, flush_level);
+        }
+        void set_compression(int c) { std::lock_guard<std::mutex> lk(mtx_); file_.set_compression(c); }
+
+        // Reads the typed arguments itself; text is only used for eagerly formatted messages.
+        bool wants_text() const override { return false; }
+
+        static void format(const LogMessage& m, FmtBuf& o, bool utc, int subsec) { format_to<false>(m, o, utc, subsec); }
+
+        // Crash: fixed buffers, thread id and deferred args as in emergency_line().
+        template<bool Crash, class Buf> static void format_to(const LogMessage& m, Buf& o, bool utc, int subsec) {
+            o.append("{\"ts\":\"", 7);
+            FixedBuf<32> t; append_time(t, m.wall, utc);   // "YYYY-MM-DD HH:MM:SS" -> ISO 8601 'T'
+            o.append(t.data(), 10); o.push_back('T'); o.append(t.data() + 11, t.size() - 11);
+            append_subsec(o, m.ts_ns, subsec);
+            if (utc) o.push_back('Z');
+            o.append("\",\"level\":\"", 11); o.append(level_name(m.level));
+            char tid[24];
+            o.append("\",\"thread\":", 11); json_string(o, Crash ? crash_tid(m.tid, tid) : tid_text(m.tid));
+            if (m.site) {
+                o.append(",\"file\":", 8); json_string(o, m.site->base);
+                o.append(",\"line\":", 8); o.append_int(m.site->line);
+                o.append(",\"func\":", 8); json_string(o, m.site->func);
+            }
+            o.append(",\"msg\":\"", 8);
+            if (m.args.empty()) {
+                json_escape(o, m.text);
+                o.push_back('"');
+            } else {
+                std::conditional_t<Crash, CrashLine, FmtBuf> v;
+                auto value = [&](const ArgPack::ArgView& a) {
+                    v.clear();
+                    if constexpr (Crash) crash_value(v, a); else ArgPack::render_value(v, a);
+                };
+                m.args.for_each([&](const ArgPack::ArgView& a) {
+                    if (!a.key.empty()) return;
+                    value(a); json_escape(o, v.view());
+                });
+                o.push_back('"');
+                m.args.for_each([&](const ArgPack::ArgView& a) {
+                    if (a.key.empty()) return;
+                    o.push_back(','); json_string(o, a.key); o.push_back(':');
+                    switch (a.tag) {
+                    case ArgPack::t_bool: if (a.i) o.append("true", 4); else o.append("false", 5); break;
+                    case ArgPack::t_i64: o.append_int(a.i); break;
+                    case ArgPack::t_u64: o.append_int(a.u); break;
+                    case ArgPack::t_f64: json_number(o, a.d); break;
+                    default: value(a); json_string(o, v.view()); break;
+                    }
+                });
+            }
+            o.append("}\n", 2);
+        }
+
+        void write(const LogMessage& m) override {
+            FmtBuf b; format(m, b, utc_, subsec_);
+            std::lock_guard<std::mutex> lk(mtx_);
+            file_.rotate_if_needed(b.size());
+            file_.append(b.data(), b.size());
+            file_.maybe_flush(m.level);
+        }
+        void write_batch(MessageSpan batch) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            int top = level::trace;
+            FmtBuf b;
+            for (auto& m : batch) {
+                b.clear(); format(m, b, utc_, subsec_);
+                file_.rotate_if_needed(b.size());
+                file_.append(b.data(), b.size());
+                if (m.level > top) top = m.level;
+            }
+            file_.maybe_flush(top);
+        }
+
+        void flush() override { std::lock_guard<std::mutex> lk(mtx_); file_.flush(); }
+        void emergency_flush() override { file_.emergency_flush(); }
+        // Always UTC on the crash path; a line that does not fit is cut and still ends in '\n'.
+        void emergency_write(const LogMessage& m) override {
+            CrashLine b; format_to<true>(m, b, true, subsec_);
+            if (b.full()) b.end_line();
+            file_.emergency_write(b.data(), b.size());
+        }
+    };
+
+    // Varints for the binary format (LEB128; signed values zigzag-encoded)
+    template<class Out> inline void put_varint(Out& out, uint64_t v) {
+        while (v >= 0x80) { out.push_back((char)(v | 0x80)); v >>= 7; }
+        out.push_back((char)v);
+    }
+    template<class Out> inline void put_svarint(Out& out, int64_t v) { put_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+    template<class Out> inline void put_bstr(Out& out, std::string_view v) { put_varint(out, v.size()); out.append(v.data(), v.size()); }
+
+    // Binary File Sink: compact records instead of text; tinylog-decode (Tools/Decode) turns a
+    // file back into exactly the lines FileSink would have written.
+    //   record := 'H' "TINYLOG" u8 version u8 utc u8 subsec      (starts every file/session; resets tables)
+    //           | 'S' varint site_id  varint line  u8 level  str file  str func
+    //           | 'T' varint thread_id  str tid_text
+    //           | 'M' varint site_id  varint thread_id  u8 level  svarint ts_delta  varint argc  arg*
+    //   arg    := [u8 t_key  str key]  u8 tag (ArgPack::t_bool..t_str) + bool/char: 1 byte
+    //             | i64: svarint | u64: varint | f64: 8 bytes | str: varint len, bytes
+    //   str    := varint len, bytes
+    // Sites and threads are written once per file and then referenced by id. Timestamps are
+    // deltas from the previous message. Deferred arguments are stored raw (numbers stay binary);
+    // literals and user types become strings, eagerly formatted messages a single string.
+    class BinaryFileSink : public LogSink {
+        std::mutex mtx_;
+        RotatingFile file_;
+        FlushTimer timer_{ mtx_, file_ };
+        bool utc_;
+        int subsec_;
+        std::unordered_map<const CallSite*, uint64_t> sites_;
+        std::unordered_map<std::thread::id, uint64_t> threads_;
+        uint64_t last_ts_ = 0;
+        // Sites/threads first seen on the crash path, where the maps must not grow: ids continue
+        // after the maps' (decoders require them in order), the first 64 are remembered for reuse.
+        const CallSite* crash_sites_[64] = {};
+        std::thread::id crash_threads_[64];
+        size_t crash_nsites_ = 0, crash_nthreads_ = 0;
+
+        void begin_file() {
+            sites_.clear(); threads_.clear(); last_ts_ = 0; crash_nsites_ = crash_nthreads_ = 0;
+            std::string& o = file_.buffer();
+            o.append("HTINYLOG", 8); o.push_back((char)2); o.push_back((char)(utc_ ? 1 : 0)); o.push_back((char)subsec_);
+        }
+
+        template<bool Crash, class Out> uint64_t site_id(Out& o, const CallSite* site) {
+            auto it = sites_.find(site);
+            if (it != sites_.end()) return it->second;
+            uint64_t id = sites_.size();
+            if constexpr (Crash) {
+                for (size_t k = 0; k < crash_nsites_ && k < 64; ++k) if (crash_sites_[k] == site) return id + k;
+                if (crash_nsites_ < 64) crash_sites_[crash_nsites_] = site;
+                id += crash_nsites_++;
+            } else {
+                sites_.emplace(site, id);
+            }
+            o.push_back('S'); put_varint(o, id); put_varint(o, (uint64_t)site->line); o.push_back((char)site->level);
+            put_bstr(o, site->file); put_bstr(o, site->func);
+            return id;
+        }
+        template<bool Crash, class Out> uint64_t thread_id(Out& o, std::thread::id tid) {
+            auto it = threads_.find(tid);
+            if (it != threads_.end()) return it->second;
+            uint64_t id = threads_.size();
+            char txt[24]; std::string_view t;
+            if constexpr (Crash) {
+                for (size_t k = 0; k < crash_nthreads_ && k < 64; ++k) if (crash_threads_[k] == tid) return id + k;
+                if (crash_nthreads_ < 64) crash_threads_[crash_nthreads_] = tid;
+                id += crash_nthreads_++;
+                t = crash_tid(tid, txt);
+            } else {
+                threads_.emplace(tid, id);
+                t = tid_text(tid);
+            }
+            o.push_back('T'); put_varint(o, id); put_bstr(o, t);
+            return id;
+        }
+
+        // Encodes into rec_ first, so rotation sees the record's real size. A record that starts
+        // a new file is encoded again: its site/thread ids refer to the old file's tables.
+        std::string rec_;
+        void encode(const LogMessage& m) {
+            rec_.clear(); encode_to<false>(m, rec_);
+            if (file_.rotate_if_needed(rec_.size())) { begin_file(); rec_.clear(); encode_to<false>(m, rec_); }
+            file_.append(rec_.data(), rec_.size());
+        }
+
+        // Crash: no map inserts, user types as in emergency_line().
+        template<bool Crash, class Out> void encode_to(const LogMessage& m, Out& o) {
+            uint64_t sid = site_id<Crash>(o, m.site);
+            uint64_t tid = thread_id<Crash>(o, m.tid);
+            o.push_back('M'); put_varint(o, sid); put_varint(o, tid); o.push_back((char)m.level);
+            put_svarint(o, (int64_t)(m.ts_ns - last_ts_)); last_ts_ = m.ts_ns;
+            if (m.args.empty()) {
+                put_varint(o, 1); o.push_back((char)ArgPack::t_str); put_bstr(o, m.text);
+                return;
+            }
+            size_t argc = 0; m.args.for_each([&](const ArgPack::ArgView&) { ++argc; });
+            put_varint(o, argc);
+            m.args.for_each([&](const ArgPack::ArgView& a) {
+                if (!a.key.empty()) { o.push_back((char)ArgPack::t_key); put_bstr(o, a.key); }
+                switch (a.tag) {
+                case ArgPack::t_bool: case ArgPack::t_char: o.push_back((char)a.tag); o.push_back((char)a.i); break;
+                case ArgPack::t_i64: o.push_back((char)a.tag); put_svarint(o, a.i); break;
+                case ArgPack::t_u64: o.push_back((char)a.tag); put_varint(o, a.u); break;
+                case ArgPack::t_f64: o.push_back((char)a.tag); { char d[8]; std::memcpy(d, &a.d, 8); o.append(d, 8); } break;
+                case ArgPack::t_obj: {
+                    o.push_back((char)ArgPack::t_str);
+                    if constexpr (Crash) put_bstr(o, "<?>");
+                    else { FmtBuf b; ArgPack::render_value(b, a); put_bstr(o, b.view()); }
+                    break;
+                }
+                default: o.push_back((char)ArgPack::t_str); put_bstr(o, a.s); break;
+                }
+            });
+        }
+
+    public:
+        BinaryFileSink(std::string path, size_t max_bytes = 64 * 1024 * 1024, int max_files = 3, bool utc = false, int subsec = time_precision::sec)
+            : file_(std::move(path), max_bytes, max_files), utc_(utc), subsec_(subsec) {
+            file_.set_counters(&counters());
+            begin_file();
+        }
+
+        void set_flush_policy(size_t bytes, std::chrono::milliseconds interval, int flush_level = level::error) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            file_.set_flush_policy(bytes, interval, flush_level);
+        }
+        void set_compression(int c) { std::lock_guard<std::mutex> lk(mtx_); file_.set_compression(c); }
+
+        bool wants_text() const override { return false; }
+
+        void write(const LogMessage& m) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            encode(m);
+            file_.maybe_flush(m.level);
+        }
+        void write_batch(MessageSpan batch) override {
+            std::lock_guard<std::mutex> lk(mtx_);
+            int top = level::trace;
+            for (auto& m : batch) {
+                encode(m);
+                if (m.level > top) top = m.level;
+            }
+            file_.maybe_flush(top);
+        }
+
+        void flush() override { std::lock_guard<std::mutex> lk(mtx_); file_.flush(); }
+        void emergency_flush() override { file_.emergency_flush(); }
+        // A record that does not fit the stack buffer is dropped whole: a cut one would derail the decoder.
+        void emergency_write(const LogMessage& m) override {
+            size_t ns = crash_nsites_, nt = crash_nthreads_; uint64_t ts = last_ts_;
+            FixedBuf<4096> b; encode_to<true>(m, b);
+            if (b.full()) { crash_nsites_ = ns; crash_nthreads_ = nt; last_ts_ = ts; return; }
+            file_.emergency_write(b.data(), b.size());
+        }
+    };
+
+    // Reads a BinaryFileSink file and writes the text lines (same layout as FileSink) to out.
+    // Local-time files are rendered in the decoding machine's time zone. A truncated final
+    // record (e.g. after a crash) ends decoding quietly; anything else malformed returns false.
+    inline bool decode_binary_log(std::istream& in, std::ostream& out) {
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const unsigned char* p = (const unsigned char*)data.data();
+        const unsigned char* end = p + data.size();
+        struct Site { std::string file, func; CallSite cs; };
+        std::vector<std::unique_ptr<Site>> sites;
+        std::vector<std::string> threads;
+        bool utc = false; int subsec = 0; uint64_t ts = 0; bool header = false;
+
+        bool ok = true;
+        auto varint = [&](uint64_t& v) {
+            v = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (p >= end) { ok = false; return false; }
+                unsigned char c = *p++; v |= (uint64_t)(c & 0x7f) << shift;
+                if (!(c & 0x80)) return true;
+            }
+            ok = false; return false;
+        };
+        auto svarint = [&](int64_t& v) { uint64_t u; if (!varint(u)) return false; v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1); return true; };
+        auto bytes = [&](size_t n, const unsigned char*& at) { if ((size_t)(end - p) < n) { ok = false; return false; } at = p; p += n; return true; };
+        auto str = [&](std::string_view& v) {
+            uint64_t n; const unsigned char* at;
+            if (!varint(n) || !bytes((size_t)n, at)) return false;
+            v = std::string_view((const char*)at, (size_t)n); return true;
+        };
+
+        FmtBuf text, line;
+        while (p < end && ok) {
+            unsigned char kind = *p++;
+            if (kind == 'H') {
+                const unsigned char* at;
+                if (!bytes(10, at)) break;
+                if (std::memcmp(at, "TINYLOG", 7) != 0 || at[7] < 1 || at[7] > 2) return false;  // 2: fields
+                utc = at[8] != 0; subsec = at[9]; ts = 0; header = true;
+                sites.clear(); threads.clear();
+            } else if (!header) {
+                return false;
+            } else if (kind == 'S') {
+                uint64_t id, ln; const unsigned char* lv; std::string_view f, fn;
+                if (!varint(id) || !varint(ln) || !bytes(1, lv) || !str(f) || !str(fn)) break;
+                if (id != sites.size()) return false;
+                std::unique_ptr<Site> s(new Site{ std::string(f), std::string(fn), CallSite{} });
+                s->cs = CallSite{ s->file.c_str(), basename_of(s->file.c_str()), s->func.c_str(), (int)ln, (int)*lv };
+                sites.push_back(std::move(s));
+            } else if (kind == 'T') {
+                uint64_t id; std::string_view t;
+                if (!varint(id) || !str(t)) break;
+                if (id != threads.size()) return false;
+                threads.emplace_back(t);
+            } else if (kind == 'M') {
+                uint64_t sid, tid, argc; const unsigned char* lv; int64_t dts;
+                if (!varint(sid) || !varint(tid) || !bytes(1, lv) || !svarint(dts) || !varint(argc)) break;
+                if (sid >= sites.size() || tid >= threads.size()) return false;
+                text.clear();
+                for (uint64_t k = 0; k < argc && ok; ++k) {
+                    const unsigned char* tg; if (!bytes(1, tg)) break;
+                    ArgPack::ArgView a; a.tag = *tg;
+                    if (a.tag == ArgPack::t_key) { if (!str(a.key) || !bytes(1, tg)) break; a.tag = *tg; }
+                    switch (a.tag) {
+                    case ArgPack::t_bool: case ArgPack::t_char: { const unsigned char* c; if (bytes(1, c)) a.i = (char)*c; break; }
+                    case ArgPack::t_i64: svarint(a.i); break;
+                    case ArgPack::t_u64: varint(a.u); break;
+                    case ArgPack::t_f64: { const unsigned char* d; if (bytes(8, d)) std::memcpy(&a.d, d, 8); break; }
+                    case ArgPack::t_str: str(a.s); break;
+                    default: return false;
+                    }
+                    if (ok) ArgPack::render_arg(text, a);
+                }
+                if (!ok) break;
+                ts += (uint64_t)dts;
+                line.clear();
+                format_line_parts(line, (int)*lv, (std::time_t)(ts / 1000000000ull), ts, threads[(size_t)tid],
+                                  sites[(size_t)sid]->cs, text.view(), utc, false, subsec);
+                line.push_back('\n');
+                out.write(line.data(), (std::streamsize)line.size());
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+#if !defined(_WIN32)
+    // Memory-mapped file sink (POSIX)
+    // Each segment file is preallocated to segment_bytes and mapped. Writers reserve a byte range
+    // with one fetch_add and memcpy the formatted line into the mapping: no lock, no syscall.
+    // When a segment fills up the next one is mapped (app.log.1, app.log.2, ...; oldest beyond
+    // max_files is deleted) and the finished one is unmapped and truncated to its real length.
+    // After a crash the last segment may end in zero padding. If a segment cannot be created,
+    // writes retry it at most every retry_gap; lines in between are dropped and counted
+    // (stats().sinks[i].dropped).
+    class MmapFileSink : public LogSink {
+        struct Segment {
+            int fd = -1;
+            char* base = nullptr;
+            size_t size = 0;
+            uint64_t seq = 0;
+            bool mapped = false;              // set before publishing: base is nulled by finish()
+            std::atomic<size_t> pos{ 0 };     // next free offset (may run past size)
+            std::atomic<size_t> limit{ 0 };   // lowest offset a reservation failed at
+            std::atomic<int> users{ 0 };      // writers currently copying into base
+        };
+        std::string path_;
+        size_t seg_bytes_;
+        int max_files_;
+        bool utc_;
+        int subsec_;
+        std::atomic<Segment*> cur_{ nullptr };
+        std::atomic<uint64_t> retry_at_{ 0 };   // now_ns() before which a failed segment isn't retried
+        std::mutex rotate_mtx_;
+        std::vector<std::unique_ptr<Segment>> segments_;  // kept for the sink's lifetime; writers may still hold stale pointers
+
+        std::string seg_path(uint64_t seq) const { return path_ + "." + std::to_string(seq); }
+
+        uint64_t last_seq_on_disk() const {
+            uint64_t last = 0; std::error_code ec;
+            fs::path p(path_);
+            std::string prefix = p.filename().string() + ".";
+            fs::path dir = p.parent_path().empty() ? fs::path(".") : p.parent_path();
+            for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+                std::string name = it->path().filename().string();
+                if (name.compare(0, prefix.size(), prefix) != 0) continue;
+                uint64_t v = 0; auto r = std::from_chars(name.data() + prefix.size(), name.data() + name.size(), v);
+                if (r.ec == std::errc() && r.ptr == name.data() + name.size() && v > last) last = v;
+            }
+            return last;
+        }
+
+        static void finish(Segment& s) {
+            while (s.users.load(std::memory_order_seq_cst) != 0) std::this_thread::yield();
+            size_t len = std::min(s.pos.load(), s.limit.load());
+            if (s.base) munmap(s.base, s.size);
+            if (s.fd >= 0) { if (ftruncate(s.fd, (off_t)len) != 0) {} ::close(s.fd); }
+            s.base = nullptr; s.fd = -1;
+        }
+
+        std::unique_ptr<Segment> map_segment(uint64_t seq) {
+            std::unique_ptr<Segment> s(new Segment);
+            s->seq = seq; s->size = seg_bytes_;
+            s->limit.store(seg_bytes_);
+            s->fd = ::open(seg_path(seq).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (s->fd >= 0) {
+#if defined(__APPLE__)
+                bool ok = ftruncate(s->fd, (off_t)seg_bytes_) == 0;
+#else
+                bool ok = posix_fallocate(s->fd, 0, (off_t)seg_bytes_) == 0 || ftruncate(s->fd, (off_t)seg_bytes_) == 0;
+#endif
+                void* p = ok ? mmap(nullptr, seg_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0) : MAP_FAILED;
+                if (p != MAP_FAILED) s->base = static_cast<char*>(p);
+            }
+            s->mapped = s->base != nullptr;
+            if (!s->mapped) {   // unusable: writers retry it (retry()) instead of reserving
+                if (s->fd >= 0) { ::close(s->fd); s->fd = -1; }
+                s->limit.store(0);
+            }
+            if (max_files_ > 0 && seq > (uint64_t)max_files_) { std::error_code ec; fs::remove(seg_path(seq - (uint64_t)max_files_), ec); }
+            return s;
+        }
+        Segment* keep(std::unique_ptr<Segment> s) { segments_.push_back(std::move(s)); return segments_.back().get(); }
+
+        void rotate(Segment* full) {
+            std::lock_guard<std::mutex> lk(rotate_mtx_);
+            if (cur_.load() != full) return;           // someone else already rotated
+            auto t0 = std::chrono::steady_clock::now();
+            Segment* next = keep(map_segment(full->seq + 1));
+            cur_.store(next, std::memory_order_seq_cst);
+            finish(*full);
+            counters().add(counters().rotations, 1);
+            counters().add(counters().rotate_ns, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+        }
+
+        static constexpr std::chrono::milliseconds retry_gap{ 100 };
+        // Tries the failed segment `bad` again (same seq). Only one writer at a time, the
+        // others drop their line instead of queueing behind the open. A failed attempt is
+        // discarded unpublished, so a disk that stays full does not grow segments_.
+        bool retry(Segment* bad) {
+            uint64_t now = now_ns();
+            if (now < retry_at_.load(std::memory_order_relaxed)) return false;
+            std::unique_lock<std::mutex> lk(rotate_mtx_, std::try_to_lock);
+            if (!lk.owns_lock()) return false;
+            if (cur_.load() != bad) return true;
+            retry_at_.store(now + (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(retry_gap).count(), std::memory_order_relaxed);
+            std::unique_ptr<Segment> s = map_segment(bad->seq);
+            if (!s->mapped) return false;
+            cur_.store(keep(std::move(s)), std::memory_order_seq_cst);
+            return true;
+        }
+
+        // One reservation for whole lines (write_batch keeps chunks within a segment). Only a
+        // single line longer than a segment is cut, and counted as dropped.
+        void put(const char* p, size_t n, size_t lines) {
+            bool cut = n > seg_bytes_;
+            if (cut) n = seg_bytes_;
+            for (int tries = 0; tries < 4; ++tries) {
+                Segment* s = cur_.load(std::memory_order_seq_cst);
+                if (!s->mapped) { if (!retry(s)) break; continue; }
+                s->users.fetch_add(1, std::memory_order_seq_cst);
+                if (cur_.load(std::memory_order_seq_cst) != s) { s->users.fetch_sub(1, std::memory_order_release); continue; }
+                size_t off = s->pos.fetch_add(n, std::memory_order_relaxed);
+                if (off + n <= s->limit.load(std::memory_order_relaxed)) {
+                    std::memcpy(s->base + off, p, n);
+                    s->users.fetch_sub(1, std::memory_order_release);
+                    counters().add(counters().bytes, n);
+                    if (cut) counters().add(counters().dropped, lines);
+                    return;
+                }
+                size_t lim = s->limit.load(std::memory_order_relaxed);
+                while (off < lim && !s->limit.compare_exchange_weak(lim, off)) {}
+                s->users.fetch_sub(1, std::memory_order_release);
+                rotate(s);
+            }
+            counters().add(counters().dropped, lines);
+        }
+    public:
+        MmapFileSink(std::string path, size_t segment_bytes = 64 * 1024 * 1024, int max_files = 3, bool utc = false, int subsec = time_precision::sec)
+            : path_(std::move(path)), seg_bytes_(segment_bytes ? segment_bytes : 64 * 1024 * 1024), max_files_(max_files), utc_(utc), subsec_(subsec) {
+            std::error_code ec; fs::create_directories(fs::path(path_).parent_path(), ec);
+            cur_.store(keep(map_segment(last_seq_on_disk() + 1)));
+        }
+        ~MmapFileSink() override {
+            std::lock_guard<std::mutex> lk(rotate_mtx_);
+            if (Segment* s = cur_.load()) finish(*s);
+        }
+
+        // Path of the segment currently being written
+        std::string current_path() const { return seg_path(cur_.load()->seq); }
+
+        bool wants_line() const override { return true; }
+        void write(const LogMessage& m) override {
+            FmtBuf b; append_line(b, m, utc_, subsec_); b.push_back('\n');
+            put(b.data(), b.size(), 1);
+        }
+        void write_batch(MessageSpan batch) override {
+            FmtBuf b, l;
+            size_t lines = 0;
+            for (auto& m : batch) {
+                l.clear(); append_line(l, m, utc_, subsec_); l.push_back('\n');
+                if (lines && b.size() + l.size() > seg_bytes_) { put(b.data(), b.size(), lines); b.clear(); lines = 0; }
+                b.append(l.data(), l.size()); ++lines;
+            }
+            if (lines) put(b.data(), b.size(), lines);
+        }
+        // The kernel already owns the bytes; this only schedules writeback.
+        void flush() override {
+            std::lock_guard<std::mutex> lk(rotate_mtx_);
+            Segment* s = cur_.load();
+            if (s && s->base) msync(s->base, std::min(s->pos.load(), s->size), MS_ASYNC);
+        }
+        // Crash path: one reservation in the current segment. No rotation (it locks and
+        // allocates): a line that does not fit is dropped.
+        void emergency_write(const LogMessage& m) override {
+            CrashLine b; emergency_line(b, m, subsec_);
+            Segment* s = cur_.load(std::memory_order_seq_cst);
+            if (!s || !s->base) return;
+            size_t off = s->pos.fetch_add(b.size(), std::memory_order_relaxed);
+            if (off + b.size() <= s->limit.load(std::memory_order_relaxed)) std::memcpy(s->base + off, b.data(), b.size());
+        }
+    };
+#endif
+
+    // Async Queue (Optional, but handy)
+#if TINYLOG_ASYNC
+
+    // What a producer does when the async queue is full
+    struct overflow {
+        enum value : int {
+            block = 0,   // spin/yield until the worker frees a slot (never loses messages)
+            drop_newest, // discard the message being logged
+            drop_oldest  // discard the oldest queued message to make room
+        };
+    };
+
+    // Where producers put messages
+    struct async_mode {
+        enum value : int {
+            shared = 0, // one MPSC ring for all threads
+            per_thread  // one SPSC ring per thread, merged by ts_ns on the worker
+        };
+    };
+
+    // Worker parking. Producers only touch the mutex when the worker is actually asleep.
+    class AsyncSignal {
+        std::atomic<bool> sleeping_{ false };
+        std::atomic<bool> urgent_{ false };     // batch > 1: an urgent note since the last park
+        std::atomic<size_t> pending_{ 0 };      // batch > 1: notes while parked
+        std::chrono::microseconds spin_{ 0 };
+        size_t batch_ = 1;
+        std::mutex mtx_; std::condition_variable cv_;
+    public:
+        // Set before the consumer starts. The consumer spins (at least 128 yields) for `spin`
+        // before parking; a parked consumer is woken by every `batch`-th note or an urgent one.
+        void set_wakeup(std::chrono::microseconds spin, size_t batch) { spin_ = spin; batch_ = batch ? batch : 1; }
+
+        void notify(bool urgent = true) {
+            if (batch_ > 1 && urgent) urgent_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!sleeping_.load(std::memory_order_relaxed)) return;
+            if (batch_ > 1 && !urgent && pending_.fetch_add(1, std::memory_order_relaxed) + 1 < batch_) return;
+            std::lock_guard<std::mutex> lk(mtx_); cv_.notify_one();
+        }
+        void wake_all() { std::lock_guard<std::mutex> lk(mtx_); cv_.notify_all(); }
+
+        // Consumer side: spin, then park until notified or max elapses. With batch > 1 it parks
+        // even if a few messages are already waiting.
+        template<class HasData>
+        void wait(HasData has_data, std::chrono::microseconds max) {
+            auto spin_end = spin_.count() ? std::chrono::steady_clock::now() + spin_ : std::chrono::steady_clock::time_point();
+            for (int i = 0; i < 128 || (spin_.count() && std::chrono::steady_clock::now() < spin_end); ++i) {
+                if (has_data()) return;
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lk(mtx_);
+            pending_.store(0, std::memory_order_relaxed);
+            sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (batch_ > 1 ? !urgent_.exchange(false, std::memory_order_relaxed) : !has_data()) cv_.wait_for(lk, max);
+            sleeping_.store(false, std::memory_order_relaxed);
+        }
+    };
+
+    // Pins the calling thread to the given CPUs (Linux; false elsewhere or if refused).
+    inline bool pin_thread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+        cpu_set_t set; CPU_ZERO(&set);
+        for (int c : cpus) if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+        return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpus; return false;
 #endif
+    }
 
-    // Helprs (FUCKY)
-    inline const char* level_name(int lv) {
-        switch (lv) {
-        case level::trace: return "TRACE";
-        case level::debug: return "DEBUG";
-        case level::info: return "INFO";
-        case level::warn: return "WARN";
-        case level::error: return "ERROR";
-        case level::critical: return "CRIT";
-        default: return "OFF";
+    // CPUs of a NUMA node, from /sys/devices/system/node/node<N>/cpulist ("0-15,32-47").
+    inline std::vector<int> numa_node_cpus(int node) {
+        std::vector<int> cpus;
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(in, list)) return cpus;
+        std::stringstream ss(list);
+        for (std::string r; std::getline(ss, r, ',');) {
+            size_t dash = r.find('-');
+            int lo = std::atoi(r.c_str()), hi = dash == std::string::npos ? lo : std::atoi(r.c_str() + dash + 1);
+            for (int c = lo; c <= hi; ++c) cpus.push_back(c);
         }
+        return cpus;
     }
 
-    inline uint64_t now_ns() {
-        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-    }
+    inline size_t round_pow2(size_t n) { size_t c = 2; while (c < n) c <<= 1; return c; }
 
-    inline std::string fmt_time(std::time_t tt, bool utc) {
-        std::tm tm{};
-#if defined(_WIN32)
-        if (utc) gmtime_s(&tm, &tt); else localtime_s(&tm, &tt);
-#else
-        if (utc) gmtime_r(&tt, &tm); else localtime_r(&tt, &tm);
-#endif
-        std::ostringstream oss;
-        oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-        return oss.str();
-    }
+    // Bounded lock-free ring of pre-allocated LogMessage slots (Vyukov-style sequence numbers).
+    // Many producers, one draining worker. drop_oldest makes producers pop too, so the
+    // dequeue side uses CAS as well; without it head_ is only ever touched by the worker.
+    class MPSCQueue {
+        struct alignas(TINYLOG_CACHELINE) Slot {
+            std::atomic<size_t> seq{ 0 };
+            LogMessage msg;
+        };
+        std::unique_ptr<Slot[]> slots_;
+        size_t mask_;
+        int policy_;
+        AsyncSignal* sig_;
+        alignas(TINYLOG_CACHELINE) std::atomic<size_t> tail_{ 0 };  // next enqueue position
+        alignas(TINYLOG_CACHELINE) std::atomic<size_t> head_{ 0 };  // next dequeue position
+        alignas(TINYLOG_CACHELINE) std::atomic<uint64_t> dropped_{ 0 };
 
-    // concat variadic to string
-    inline void to_string_impl(std::ostringstream&) {}
+        bool try_push(LogMessage& m) {
+            Slot* s; size_t pos = tail_.load(std::memory_order_relaxed);
+            for (;;) {
+                s = &slots_[pos & mask_];
+                size_t seq = s->seq.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+                if (dif == 0) { if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break; }
+                else if (dif < 0) return false; // full
+                else pos = tail_.load(std::memory_order_relaxed);
+            }
+            s->msg = std::move(m);
+            s->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+    public:
+        explicit MPSCQueue(size_t capacity = 8192, int policy = overflow::block, AsyncSignal* sig = nullptr)
+            : slots_(new Slot[round_pow2(capacity)]), mask_(round_pow2(capacity) - 1), policy_(policy), sig_(sig) {
+            for (size_t i = 0; i <= mask_; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
 
-    template<class T, class... Rest>
-    inline void to_string_impl(std::ostringstream& oss, T&& t, Rest&&... rest) {
-        oss << std::forward<T>(t);
-        if constexpr (sizeof...(rest) > 0) to_string_impl(oss, std::forward<Rest>(rest)...);
-    }
+        size_t capacity() const { return mask_ + 1; }
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+        size_t size_approx() const {
+            size_t t = tail_.load(std::memory_order_relaxed), h = head_.load(std::memory_order_relaxed);
+            return t > h ? t - h : 0;
+        }
+        bool empty() const {
+            size_t pos = head_.load(std::memory_order_acquire);
+            return slots_[pos & mask_].seq.load(std::memory_order_acquire) != pos + 1;
+        }
 
-    template<class... Ts>
-    inline std::string cat(Ts&&... ts) {
-        std::ostringstream oss; oss.setf(std::ios::fixed); oss.precision(6);
-        to_string_impl(oss, std::forward<Ts>(ts)...); return oss.str();
-    }
+        // Returns false if the message was dropped by the overflow policy.
+        bool push(LogMessage&& m) {
+            for (int spins = 0; !try_push(m); ++spins) {
+                if (policy_ == overflow::drop_newest) { dropped_.fetch_add(1, std::memory_order_relaxed); return false; }
+                if (policy_ == overflow::drop_oldest) {
+                    LogMessage victim;
+                    if (try_pop(victim)) dropped_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                if (sig_) sig_->notify();
+                if (spins > 64) std::this_thread::yield();
+            }
+            return true;
+        }
 
-    // Log Message
-    struct LogMessage {
-        int level;
-        uint64_t ts_ns;   // monotonic
-        std::time_t wall; // wall clock seconds
-        std::thread::id tid;
-        const char* file;
-        const char* func;
-        int line;
-        std::string text;
-    };
+        bool try_pop(LogMessage& out) {
+            Slot* s; size_t pos = head_.load(std::memory_order_relaxed);
+            for (;;) {
+                s = &slots_[pos & mask_];
+                size_t seq = s->seq.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+                if (dif == 0) { if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break; }
+                else if (dif < 0) return false; // empty
+                else pos = head_.load(std::memory_order_relaxed);
+            }
+            out = std::move(s->msg);
+            s->seq.store(pos + mask_ + 1, std::memory_order_release);
+            return true;
+        }
 
-    // Pretty, unified formatter (used by both sinks)
-    inline std::string format_line(const LogMessage& m, bool utc, bool colorize = false) {
-        // Example: LOC 2025-09-15 22:13:31 [DEBUG] (thread:1234) main.cpp:24 main | message...
-        std::ostringstream line;
-        line << (utc ? "UTC" : "LOC") << " " << fmt_time(m.wall, utc)
-            << " [" << level_name(m.level) << "] "
-            << "(tid:" << m.tid << ") "
-            << fs::path(m.file).filename().string() << ":" << m.line << " "
-            << m.func << " | " << m.text;
-        if (!colorize) return line.str();
-
-        const char* col = "\033[0m";
-        switch (m.level) {
-        case level::trace:    col = "\033[90m"; break;
-        case level::debug:    col = "\033[36m"; break;
-        case level::info:     col = "\033[37m"; break;
-        case level::warn:     col = "\033[33m"; break;
-        case level::error:    col = "\033[31m"; break;
-        case level::critical: col = "\033[41;97m"; break;
-        default: break;
+        // Moves up to max messages into out (appended). Returns how many were taken.
+        size_t pop_batch(std::vector<LogMessage>& out, size_t max) {
+            size_t n = 0; LogMessage m;
+            while (n < max && try_pop(m)) { out.push_back(std::move(m)); ++n; }
+            return n;
         }
-        std::ostringstream colored;
-        colored << col << line.str() << "\033[0m";
-        return colored.str();
-    }
 
-    // Sink Interface
-    class LogSink {
-    public:
-        virtual ~LogSink() = default;
-        virtual void write(const LogMessage& m) = 0;
+        // Visits queued messages without taking them. Crash path only: no locks, and a slot
+        // being written concurrently is skipped.
+        template<class F> void peek(F f) const {
+            size_t pos = head_.load(std::memory_order_acquire), end = tail_.load(std::memory_order_acquire);
+            if (end - pos > mask_ + 1) return;
+            for (; pos != end; ++pos) {
+                const Slot& s = slots_[pos & mask_];
+                if (s.seq.load(std::memory_order_acquire) == pos + 1) f(s.msg);
+            }
+        }
     };
 
-    // Console Sink (Colored)
-    class ConsoleSink : public LogSink {
-        bool use_color_;
-        bool utc_;
+    // Single-producer ring owned by one logging thread (async_mode::per_thread).
+    // Head and tail live on separate cache lines and each side caches the other's index,
+    // so the producer only reads the worker's line when its cached view says "full".
+    // drop_oldest behaves as drop_newest here: only the worker may advance head_.
+    class SPSCQueue {
+        std::unique_ptr<LogMessage[]> slots_;
+        size_t mask_;
+        int policy_;
+        AsyncSignal* sig_;
+        alignas(TINYLOG_CACHELINE) std::atomic<size_t> tail_{ 0 };
+        size_t head_cache_ = 0;                        // producer's view of head_
+        std::atomic<uint64_t> dropped_{ 0 };           // producer-written
+        alignas(TINYLOG_CACHELINE) std::atomic<size_t> head_{ 0 };
+        size_t tail_cache_ = 0;                        // worker's view of tail_
+        std::atomic<bool> orphaned_{ false };          // owning thread has exited
     public:
-        explicit ConsoleSink(bool color = true, bool utc = false) : use_color_(color), utc_(utc) {}
-        void write(const LogMessage& m) override {
-            std::cout << format_line(m, utc_, use_color_) << "\n";
-            // Force immediate flush so short-lived programs always show logs:
-            std::cout << std::flush;
+        explicit SPSCQueue(size_t capacity = 1024, int policy = overflow::block, AsyncSignal* sig = nullptr)
+            : slots_(new LogMessage[round_pow2(capacity)]), mask_(round_pow2(capacity) - 1), policy_(policy), sig_(sig) {
         }
-    };
 
-    // File Sink w/ rotation
-    class FileSink : public LogSink {
-        std::mutex mtx_;
-        std::string path_;
-        size_t max_bytes_;
-        int max_files_;
-        std::ofstream out_;
-        bool utc_;
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+        size_t size_approx() const { return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed); }
+        bool empty() const { return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_acquire); }
+        void orphan() { orphaned_.store(true, std::memory_order_release); }
+        bool orphaned() const { return orphaned_.load(std::memory_order_acquire); }
 
-        void ensure_dir() {
-            std::error_code ec;
-            fs::create_directories(fs::path(path_).parent_path(), ec);
+        bool push(LogMessage&& m) {
+            size_t t = tail_.load(std::memory_order_relaxed);
+            for (int spins = 0; t - head_cache_ > mask_; ++spins) {
+                head_cache_ = head_.load(std::memory_order_acquire);
+                if (t - head_cache_ <= mask_) break;
+                if (policy_ != overflow::block) { dropped_.fetch_add(1, std::memory_order_relaxed); return false; }
+                if (sig_) sig_->notify();
+                if (spins > 64) std::this_thread::yield();
+            }
+            slots_[t & mask_] = std::move(m);
+            tail_.store(t + 1, std::memory_order_release);
+            return true;
         }
-        void open_file() {
-            if (out_.is_open()) return;
-            ensure_dir();
-            out_.open(path_, std::ios::app | std::ios::out);
-        }
-        uintmax_t size_now() {
-            std::error_code ec; auto s = fs::file_size(path_, ec); return ec ? 0 : s;
-        }
-        void rotate_if_needed() {
-            if (max_bytes_ == 0) return;
-            auto s = size_now();
-            if (s < max_bytes_) return;
-            out_.close();
-            for (int i = max_files_ - 1; i >= 1; --i) {
-                fs::path from = (i == 1 ? fs::path(path_) : fs::path(path_).concat("." + std::to_string(i - 1)));
-                fs::path to = fs::path(path_).concat("." + std::to_string(i));
-                std::error_code ec; if (fs::exists(from, ec)) {
-                    std::error_code ec2; fs::rename(from, to, ec2);
-                    if (ec2) { fs::remove(to, ec2); fs::rename(from, to, ec2); }
+
+        size_t pop_batch(std::vector<LogMessage>& out, size_t max) {
+            size_t h = head_.load(std::memory_order_relaxed);
+            if (h == tail_cache_) { tail_cache_ = tail_.load(std::memory_order_acquire); if (h == tail_cache_) return 0; }
+            size_t n = tail_cache_ - h; if (n > max) n = max;
+            for (size_t i = 0; i < n; ++i) out.push_back(std::move(slots_[(h + i) & mask_]));
+            head_.store(h + n, std::memory_order_release);
+            return n;
+        }
+        // See MPSCQueue::peek.
+        template<class F> void peek(F f) const {
+            size_t h = head_.load(std::memory_order_acquire), t = tail_.load(std::memory_order_acquire);
+            if (t - h > mask_ + 1) return;
+            for (; h != t; ++h) f(slots_[h & mask_]);
+        }
+    };
+
+    // Gives one sink its own queue and drain thread, so a slow sink (network, console) can't hold
+    // back the others. Logger writes to it like any sink; the wrapped sink is only written from
+    // the AsyncSink thread. Takes the wrapped sink's level at construction.
+    //   logger.add_sink(std::make_shared<tinylog::AsyncSink>(std::make_shared<tinylog::ConsoleSink>()));
+    class AsyncSink : public LogSink {
+        std::shared_ptr<LogSink> inner_;
+        AsyncSignal sig_;
+        MPSCQueue q_;
+        std::atomic<bool> running_{ true };
+        std::atomic<bool> busy_{ false };   // worker holds popped messages not yet written
+        std::thread worker_;
+
+        void loop() {
+            std::vector<LogMessage> batch; batch.reserve(256);
+            for (;;) {
+                busy_.store(true);
+                batch.clear(); q_.pop_batch(batch, 256);
+                if (!batch.empty()) {
+                    auto t0 = std::chrono::steady_clock::now();
+                    inner_->write_batch(MessageSpan{ batch.data(), batch.size() });
+                    inner_->counters().add_latency((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
                 }
+                busy_.store(false);
+                if (!batch.empty()) continue;
+                if (!running_.load(std::memory_order_acquire)) { if (q_.empty()) break; continue; }
+                inner_->flush();
+                sig_.wait([this] { return !q_.empty(); }, std::chrono::milliseconds(50));
             }
-            open_file();
+            inner_->flush();
         }
+        // The shared line points into the caller's buffer and would not outlive write().
+        static LogMessage copy(const LogMessage& m) { LogMessage c(m); c.line = {}; return c; }
     public:
-        FileSink(std::string path, size_t max_bytes = 5 * 1024 * 1024, int max_files = 3, bool utc = false)
-            : path_(std::move(path)), max_bytes_(max_bytes), max_files_(max_files), utc_(utc) {
-            open_file();
+        explicit AsyncSink(std::shared_ptr<LogSink> inner, size_t capacity = 8192, int policy = overflow::block)
+            : inner_(std::move(inner)), q_(capacity, policy, &sig_) {
+            set_level(inner_->level());
+            worker_ = std::thread([this] { loop(); });
         }
-        void write(const LogMessage& m) override {
-            std::lock_guard<std::mutex> lk(mtx_);
-            rotate_if_needed();
-            if (!out_.is_open()) open_file();
-            out_ << format_line(m, utc_, false) << '\n';
-            out_.flush();
+        ~AsyncSink() { running_.store(false, std::memory_order_release); sig_.wake_all(); worker_.join(); }
+
+        bool wants_text() const override { return inner_->wants_text(); }
+        uint64_t dropped() const { return q_.dropped(); }
+        // Bytes and rotations are the wrapped sink's; latency is its write calls on this thread.
+        const SinkCounters& stats_counters() const override { return inner_->stats_counters(); }
+
+        void write(const LogMessage& m) override { q_.push(copy(m)); sig_.notify(); }
+        void write_batch(MessageSpan batch) override {
+            for (auto& m : batch) q_.push(copy(m));
+            sig_.notify();
+        }
+        // Doesn't block: the drain thread flushes the wrapped sink whenever it runs out of work.
+        void flush() override { sig_.notify(); }
+        // Blocks until everything queued so far has reached the wrapped sink, then flushes it.
+        void drain() {
+            while (!q_.empty() || busy_.load()) { sig_.notify(); std::this_thread::yield(); }
+            inner_->flush();
+        }
+        void emergency_flush() override {
+            inner_->emergency_flush();
+            q_.peek([this](const LogMessage& m) { inner_->emergency_write(m); });
         }
+        void emergency_write(const LogMessage& m) override { inner_->emergency_write(m); }
     };
+#endif
 
-    // Async Queue (Optional, but handy)
-#if TINYLOG_ASYNC
-    class MPMCQueue {
-        std::mutex mtx_; std::condition_variable cv_; std::queue<LogMessage> q_; bool closed_ = false;
-    public:
-        void push(LogMessage m) { std::lock_guard<std::mutex> lk(mtx_); q_.push(std::move(m)); cv_.notify_one(); }
-        bool pop(LogMessage& out) { std::unique_lock<std::mutex> lk(mtx_); cv_.wait(lk, [&] {return closed_ || !q_.empty(); }); if (q_.empty()) return false; out = std::move(q_.front()); q_.pop(); return true; }
-        void close() { std::lock_guard<std::mutex> lk(mtx_); closed_ = true; cv_.notify_all(); }
+    // ---------- Self-metrics ----------
+    struct SinkStats {
+        const LogSink* sink;      // identifies the sink; index in LoggerStats::sinks = add order
+        uint64_t bytes;           // written to the file/console so far
+        uint64_t rotations;
+        uint64_t rotate_ns;
+        uint64_t dropped;
+        uint64_t latency[SinkCounters::buckets];   // sampled write calls, see SinkCounters
+        uint64_t latency_ns;                       // their total duration
     };
-#endif
+    struct LoggerStats {
+        uint64_t enqueued = 0;       // messages past level/site filters
+        uint64_t dispatched = 0;     // messages handed to the sinks
+        uint64_t dropped = 0;        // async overflow policy
+        size_t queue_depth = 0;      // async: messages waiting right now
+        size_t queue_high_water = 0; // async: deepest the queue got
+        std::vector<SinkStats> sinks;
+    };
+
+    // Prometheus text exposition of a stats() snapshot; latency as a cumulative histogram.
+    // Each family is one # TYPE line followed by all of its samples (one per sink).
+    inline std::string format_prometheus(const LoggerStats& st, std::string_view prefix = "tinylog") {
+        FmtBuf b;
+        auto type = [&](const char* name, const char* kind) {
+            b.append("# TYPE "); b.append(prefix); b.push_back('_'); b.append(name); b.push_back(' '); b.append(kind); b.push_back('\n');
+        };
+        auto metric = [&](const char* name, uint64_t v, const char* labels = nullptr) {
+            b.append(prefix); b.push_back('_'); b.append(name);
+            if (labels) { b.push_back('{'); b.append(labels); b.push_back('}'); }
+            b.push_back(' '); b.append_int(v); b.push_back('\n');
+        };
+        type("messages_enqueued_total", "counter"); metric("messages_enqueued_total", st.enqueued);
+        type("messages_dispatched_total", "counter"); metric("messages_dispatched_total", st.dispatched);
+        type("messages_dropped_total", "counter"); metric("messages_dropped_total", st.dropped);
+        type("queue_depth", "gauge"); metric("queue_depth", st.queue_depth);
+        type("queue_high_water", "gauge"); metric("queue_high_water", st.queue_high_water);
+        std::vector<std::string> labels;
+        for (size_t i = 0; i < st.sinks.size(); ++i) labels.push_back("sink=\"" + std::to_string(i) + "\"");
+        auto per_sink = [&](const char* name, const char* kind, uint64_t SinkStats::*f) {
+            type(name, kind);
+            for (size_t i = 0; i < st.sinks.size(); ++i) metric(name, st.sinks[i].*f, labels[i].c_str());
+        };
+        per_sink("sink_bytes_total", "counter", &SinkStats::bytes);
+        per_sink("sink_rotations_total", "counter", &SinkStats::rotations);
+        per_sink("sink_rotate_ns_total", "counter", &SinkStats::rotate_ns);
+        per_sink("sink_dropped_total", "counter", &SinkStats::dropped);
+        type("sink_write_ns", "histogram");
+        for (size_t i = 0; i < st.sinks.size(); ++i) {
+            const SinkStats& s = st.sinks[i];
+            const std::string& l = labels[i];
+            uint64_t cum = 0;
+            for (int k = 0; k < SinkCounters::buckets - 1; ++k) {
+                cum += s.latency[k];
+                std::string lb = l + ",le=\"" + std::to_string(2ull << k) + "\"";
+                metric("sink_write_ns_bucket", cum, lb.c_str());
+            }
+            cum += s.latency[SinkCounters::buckets - 1];
+            metric("sink_write_ns_bucket", cum, (l + ",le=\"+Inf\"").c_str());
+            metric("sink_write_ns_sum", s.latency_ns, l.c_str());
+            metric("sink_write_ns_count", cum, l.c_str());
+        }
+        return b.str();
+    }
 
     // ---------- Logger ----------
     class Logger {
     public:
         using sink_ptr = std::shared_ptr<LogSink>;
     private:
+        friend void sink_levels_changed();
+        // Immutable sink list, swapped whole on add_sink (copy-on-write). Dispatch reads it with
+        // one acquire load of a raw pointer: no lock, no refcount. Replaced lists are retired,
+        // not freed, until the Logger goes (add_sink is rare), so a reader, or the crash handler,
+        // never sees one disappear. mtx_ only serializes writers.
+        struct SinkList {
+            std::vector<sink_ptr> sinks;
+        };
         std::mutex mtx_;
-        std::vector<sink_ptr> sinks_;
+        std::vector<std::unique_ptr<const SinkList>> lists_{};   // every list published (mtx_)
+        std::atomic<const SinkList*> sinks_{ nullptr };          // the current one
         std::atomic<int> level_{ TINYLOG_LEVEL };
+        // Derived from level_ and the sink levels by refresh_levels():
+        std::atomic<int> threshold_{ TINYLOG_LEVEL };  // max(level_, lowest sink level)
+        std::atomic<int> sink_floor_{ level::trace };  // lowest sink level
+        std::atomic<int> text_floor_{ level::off };    // lowest level any text sink takes
+        std::atomic<int> args_floor_{ level::off };    // lowest level any args-only sink takes
+        // stats(): one counter bump per message. enqueued_ counts async pushes, dispatched_
+        // messages dispatched on the logging thread, batched_ those from the worker.
+        ShardedCounter enqueued_, dispatched_;
+        std::atomic<uint64_t> batched_{ 0 };
         bool utc_{ false };
+        int subsec_{ time_precision::sec };
+        size_t file_flush_bytes_ = 64 * 1024;
+        std::chrono::milliseconds file_flush_interval_{ 1000 };
+        int file_flush_level_ = level::error;
+        int file_compression_ = compression::none;
+        FmtBuf lines_;                   // worker only: shared lines of the current batch
+        std::vector<size_t> line_ends_;
+
+        std::mutex sites_mtx_;
+        struct Interned { CallSite site; SiteState state; };
+        std::map<std::tuple<const char*, int, const char*, int>, std::unique_ptr<Interned>> interned_;
+        // Registered LOG_* sites and the enable/disable rules applied to them (last match wins).
+        std::vector<std::pair<const CallSite*, SiteState*>> sites_;
+        std::vector<std::pair<std::string, bool>> site_rules_;
+        std::vector<std::pair<const CallSite*, SiteLimiter*>> limiters_;  // sites with suppressed counts
+        std::vector<ScopeStats*> scopes_;                                  // LOG_SCOPE_STATS sites seen
+        std::atomic<uint64_t> scope_interval_ns_{ 60000000000ull };
+        std::atomic<uint64_t> scope_due_ns_{ 0 };                          // now_ns() of the next summary
+        void track_limiter(const CallSite* site, SiteLimiter* lim) {
+            if (lim->tracked.exchange(true, std::memory_order_relaxed)) return;
+            { std::lock_guard<std::mutex> lk(sites_mtx_); limiters_.emplace_back(site, lim); }
+            start_report_tick();
+        }
+        // Sync mode has no worker to report pending counts and scope summaries: the maintenance
+        // thread does it (started with the first rate-limited or LOG_SCOPE_STATS site).
+        std::atomic<bool> report_tick_on_{ false };
+        uint64_t report_tick_ = 0;
+        std::chrono::steady_clock::time_point last_report_{};   // maintenance thread only
+        // Not under sites_mtx_: ticks run under the maintenance lock and take sites_mtx_.
+        void start_report_tick() {
+            if (!report_tick_on_.exchange(true)) report_tick_ = FileMaintenance::instance().add_tick([this] { report_tick(); });
+        }
+        void report_tick() {
+#if TINYLOG_ASYNC
+            if (running_.load(std::memory_order_acquire)) return;   // the worker reports
+#endif
+            maybe_report_scopes(true);
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_report_ < std::chrono::seconds(1)) return;
+            last_report_ = now;
+            report_all(true);
+        }
+
+        // Rule verdict for a site: +1 forced on, -1 forced off, 0 no rule matches.
+        int site_rule(const CallSite* site) const {
+            if (site_rules_.empty()) return 0;
+            std::string at = std::string(site->base) + ":" + std::to_string(site->line);
+            int r = 0;
+            for (auto& rule : site_rules_) {
+                const char* g = rule.first.c_str();
+                if (glob_match(g, site->file) || glob_match(g, site->base) || glob_match(g, site->func) || glob_match(g, at.c_str()))
+                    r = rule.second ? 1 : -1;
+            }
+            return r;
+        }
+        // Forced-on sites ignore set_level() but still need a sink that takes their level.
+        unsigned char site_value(const CallSite* site) const {
+            int r = site_rule(site);
+            int need = r > 0 ? sink_floor_.load(std::memory_order_relaxed) : threshold_.load(std::memory_order_relaxed);
+            return (r >= 0 && site->level >= need) ? site_state::on : site_state::off;
+        }
+        void refresh_sites_locked() {
+            for (auto& e : sites_) e.second->v.store(site_value(e.first), std::memory_order_relaxed);
+        }
+        bool register_site(const CallSite* site, SiteState* st) {
+            std::lock_guard<std::mutex> lk(sites_mtx_);
+            const void* owner = st->owner.load(std::memory_order_relaxed);
+            if (!owner) {
+                st->owner.store(this, std::memory_order_relaxed);
+                sites_.emplace_back(site, st);
+                st->v.store(site_value(site), std::memory_order_relaxed);
+            }
+            else if (owner != this) return site_value(site) == site_state::on;  // another logger's site
+            return st->v.load(std::memory_order_relaxed) == site_state::on;
+        }
+
+        // Every live Logger: sink level changes refresh them all, and the crash handler drains
+        // the first crash_slots of them. Leaked so it outlives the loggers.
+        static constexpr int crash_slots = 32;
+        struct Registry {
+            std::mutex mtx;
+            std::vector<Logger*> all;
+            std::atomic<Logger*> crash[crash_slots]{};
+        };
+        static Registry& registry() { static Registry* r = new Registry(); return *r; }
+        void enlist() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lk(r.mtx);
+            r.all.push_back(this);
+            for (auto& slot : r.crash) { Logger* e = nullptr; if (slot.compare_exchange_strong(e, this)) break; }
+        }
+        void delist() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lk(r.mtx);
+            r.all.erase(std::remove(r.all.begin(), r.all.end(), this), r.all.end());
+            for (auto& slot : r.crash) { Logger* me = this; if (slot.compare_exchange_strong(me, nullptr)) break; }
+        }
 
         // NEW: default file location pieces
         std::string log_dir_ = "logs";
@@ -253,16 +2791,181 @@ namespace tinylog {
         std::string log_ext_ = ".tiny";
 
 #if TINYLOG_ASYNC
-        MPMCQueue q_;
+        std::unique_ptr<MPSCQueue> q_;
+        AsyncSignal sig_;
         std::thread worker_;
         std::atomic<bool> running_{ false };
+        size_t async_capacity_ = 8192;
+        int overflow_ = overflow::block;
+        int async_mode_ = async_mode::shared;
+        static constexpr size_t batch_size_ = 256;
+        std::vector<int> worker_cpus_;                           // empty: not pinned
+        std::atomic<bool> worker_pinned_{ false };
+        std::chrono::microseconds wake_max_delay_{ 50000 };
+        int wake_level_ = level::error;                          // wakes a batching worker at once
+
+        // per_thread mode: registry of thread rings (written on registration, read by the worker)
+        std::mutex rings_mtx_;
+        std::vector<std::shared_ptr<SPSCQueue>> rings_;
+        std::atomic<uint64_t> rings_version_{ 0 };
+        std::atomic<uint64_t> retired_drops_{ 0 };
+        std::vector<std::pair<uint64_t, uint32_t>> order_;  // worker scratch for drain_rings
+        std::vector<LogMessage> sorted_;
+        std::atomic<bool> busy_{ false };                        // worker holds popped messages
+        std::atomic<bool> crashed_{ false };                     // emergency_drain() took over
+        std::atomic<size_t> high_water_{ 0 };                    // deepest queue seen by the worker
+        std::atomic<const std::vector<LogMessage>*> inflight_{ nullptr };  // batch being dispatched
+
+        // The calling thread's ring for this logger, registered on first use. The thread_local
+        // keeps the rings alive until the thread exits; after that the workers drain and
+        // unregister them.
+        SPSCQueue& thread_ring() {
+            struct Local {
+                std::vector<std::pair<const Logger*, std::shared_ptr<SPSCQueue>>> rings;
+                size_t last = 0;
+                ~Local() { for (auto& r : rings) r.second->orphan(); }
+            };
+            static thread_local Local tl;
+            if (tl.last < tl.rings.size() && tl.rings[tl.last].first == this) return *tl.rings[tl.last].second;
+            for (size_t i = 0; i < tl.rings.size(); ++i)
+                if (tl.rings[i].first == this) { tl.last = i; return *tl.rings[i].second; }
+            auto ring = std::make_shared<SPSCQueue>(async_capacity_, overflow_, &sig_);
+            {
+                std::lock_guard<std::mutex> lk(rings_mtx_);
+                rings_.push_back(ring);
+                rings_version_.fetch_add(1, std::memory_order_release);
+            }
+            tl.last = tl.rings.size();
+            tl.rings.emplace_back(this, std::move(ring));
+            return *tl.rings[tl.last].second;
+        }
+
+        // Pull a fair share from every thread ring, then order the batch by timestamp.
+        // Ordering is global within a batch and approximately global across batches.
+        size_t drain_rings(std::vector<std::shared_ptr<SPSCQueue>>& local, uint64_t& seen, std::vector<LogMessage>& batch) {
+            uint64_t v = rings_version_.load(std::memory_order_acquire);
+            if (v != seen) { std::lock_guard<std::mutex> lk(rings_mtx_); local = rings_; seen = v; }
+            if (local.empty()) return 0;
+            size_t depth = 0;
+            for (auto& r : local) depth += r->size_approx();
+            note_depth(depth);
+            size_t quota = batch_size_ / local.size(); if (quota < 16) quota = 16;
+            bool retire = false;
+            for (auto& r : local) {
+                r->pop_batch(batch, quota);
+                if (r->orphaned() && r->empty()) retire = true;
+            }
+            if (retire) {
+                std::lock_guard<std::mutex> lk(rings_mtx_);
+                for (size_t i = 0; i < rings_.size();) {
+                    if (rings_[i]->orphaned() && rings_[i]->empty()) {
+                        retired_drops_.fetch_add(rings_[i]->dropped(), std::memory_order_relaxed);
+                        rings_.erase(rings_.begin() + (std::ptrdiff_t)i);
+                    } else ++i;
+                }
+                rings_version_.fetch_add(1, std::memory_order_release);
+            }
+            // Merge by timestamp: sort (ts, index) pairs, then move each message once.
+            auto by_ts = [](const LogMessage& a, const LogMessage& b) { return a.ts_ns < b.ts_ns; };
+            if (!std::is_sorted(batch.begin(), batch.end(), by_ts)) {
+                order_.clear();
+                for (size_t i = 0; i < batch.size(); ++i) order_.emplace_back(batch[i].ts_ns, (uint32_t)i);
+                std::stable_sort(order_.begin(), order_.end(), [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) { return a.first < b.first; });
+                sorted_.clear();
+                for (auto& o : order_) sorted_.push_back(std::move(batch[o.second]));
+                batch.swap(sorted_);
+            }
+            return batch.size();
+        }
+
+        void note_depth(size_t d) { if (d > high_water_.load(std::memory_order_relaxed)) high_water_.store(d, std::memory_order_relaxed); }
+        size_t queue_depth() {
+            if (async_mode_ == async_mode::shared) return q_ ? q_->size_approx() : 0;
+            size_t n = 0;
+            std::lock_guard<std::mutex> lk(rings_mtx_);
+            for (auto& r : rings_) n += r->size_approx();
+            return n;
+        }
+
+        bool queues_empty() {
+            if (async_mode_ == async_mode::shared) return q_->empty();
+            std::lock_guard<std::mutex> lk(rings_mtx_);
+            for (auto& r : rings_) if (!r->empty()) return false;
+            return true;
+        }
+
+        void worker_loop() {
+            std::vector<LogMessage> batch; batch.reserve(batch_size_ * 2);
+            std::vector<std::shared_ptr<SPSCQueue>> rings; uint64_t rings_seen = ~0ull;
+            auto last_report = std::chrono::steady_clock::now();
+            for (;;) {
+                batch.clear();
+                busy_.store(true);
+                if (crashed_.load()) { busy_.store(false); std::this_thread::sleep_for(std::chrono::seconds(1)); continue; }
+                if (async_mode_ == async_mode::shared) note_depth(q_->size_approx());
+                size_t n = async_mode_ == async_mode::shared ? q_->pop_batch(batch, batch_size_)
+                                                             : drain_rings(rings, rings_seen, batch);
+                // Checked every round, so a steady stream from other sites doesn't hold the counts back.
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_report >= std::chrono::seconds(1)) { report_all(true); last_report = now; }
+                maybe_report_scopes(true);
+                if (n == 0) {
+                    busy_.store(false);
+                    if (!running_.load(std::memory_order_acquire)) { if (queues_empty()) break; continue; }
+                    flush_sinks();  // idle: don't leave buffered lines sitting in sinks
+                    sig_.wait([this] { return !queues_empty(); }, wake_max_delay_);
+                    continue;
+                }
+                inflight_.store(&batch, std::memory_order_release);
+                dispatch_batch(batch);
+                inflight_.store(nullptr, std::memory_order_release);
+                busy_.store(false);
+            }
+        }
 #endif
 
-        Logger() = default;
-        ~Logger() {
+#if !defined(_WIN32)
+        static constexpr int crash_signals_[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+        static struct sigaction* crash_prev() { static struct sigaction a[5]; return a; }
+        static void on_crash(int sig) {
+            static std::atomic<bool> entered{ false };
+            if (!entered.exchange(true))
+                for (auto& slot : registry().crash) if (Logger* l = slot.load(std::memory_order_acquire)) l->emergency_drain();
+            // Hand over to whatever was installed before (default: core dump) and re-raise.
+            for (int i = 0; i < 5; ++i) if (crash_signals_[i] == sig) sigaction(sig, &crash_prev()[i], nullptr);
+            raise(sig);
+        }
+        // Sinks write their buffers, then every message the async worker has not finished
+        // (in-flight batch first, so its lines may appear twice) and everything still queued.
+        void emergency_drain() {
+            const SinkList* sl = sinks_.load(std::memory_order_acquire);
+            if (!sl) return;
+#if TINYLOG_ASYNC
+            // Park the worker first (it may be mid-batch: give it up to ~100 ms), so it doesn't
+            // write the same lines again behind us. If it is the crashing thread it stays busy.
+            crashed_.store(true);
+            for (int i = 0; i < 100 && busy_.load(); ++i) { timespec ts{ 0, 1000000 }; nanosleep(&ts, nullptr); }
+#endif
+            for (auto& s : sl->sinks) s->emergency_flush();
 #if TINYLOG_ASYNC
-            if (running_) { running_ = false; q_.close(); if (worker_.joinable()) worker_.join(); }
+            auto emit = [sl](const LogMessage& m) {
+                for (auto& s : sl->sinks) if (m.level >= s->level()) s->emergency_write(m);
+            };
+            if (running_.load(std::memory_order_relaxed)) {
+                if (busy_.load())
+                    if (auto* b = inflight_.load(std::memory_order_acquire)) for (auto& m : *b) emit(m);
+                if (q_) q_->peek(emit);
+                for (auto& r : rings_) r->peek(emit);
+            }
+#endif
+        }
 #endif
+
+        std::string name_;
+        explicit Logger(std::string name = std::string()) : name_(std::move(name)) {
+            lists_.emplace_back(new SinkList());
+            sinks_.store(lists_.back().get(), std::memory_order_release);
+            enlist();
         }
 
         std::string sanitized_ext(const std::string& e) const {
@@ -271,11 +2974,37 @@ namespace tinylog {
         }
     public:
         Logger(const Logger&) = delete; Logger& operator=(const Logger&) = delete;
+        ~Logger() {
+            delist();
+#if TINYLOG_ASYNC
+            // Stop accepting, then let the worker drain whatever is still queued.
+            if (running_) { running_ = false; sig_.wake_all(); if (worker_.joinable()) worker_.join(); }
+#endif
+            if (report_tick_on_.load()) FileMaintenance::instance().remove_tick(report_tick_);
+            report_all(true);
+        }
+
         static Logger& instance() { static Logger L; return L; }
+        // A named logger, created on first use and kept until exit. Each one has its own sinks,
+        // levels, site rules and async worker; log to it with the LOG_*_TO(logger, ...) macros.
+        // get("") is instance(). Each call locks and looks the name up: keep the reference
+        // (static auto& net = Logger::get("net");) instead of calling it per message.
+        static Logger& get(std::string_view name) {
+            if (name.empty()) return instance();
+            static std::mutex mtx;
+            static std::map<std::string, std::unique_ptr<Logger>, std::less<>> named;
+            std::lock_guard<std::mutex> lk(mtx);
+            auto it = named.find(name);
+            if (it == named.end()) it = named.emplace(std::string(name), std::unique_ptr<Logger>(new Logger(std::string(name)))).first;
+            return *it->second;
+        }
+        const std::string& name() const { return name_; }
 
-        void set_level(int lv) { level_.store(lv, std::memory_order_relaxed); }
+        void set_level(int lv) { level_.store(lv, std::memory_order_relaxed); std::lock_guard<std::mutex> lk(mtx_); refresh_levels_locked(); }
         int  get_level() const { return level_.load(std::memory_order_relaxed); }
         void set_utc(bool v) { utc_ = v; }
+        // Sub-second digits in timestamps (time_precision::ms/us/ns); like set_utc, affects sinks added afterwards.
+        void set_time_precision(int digits) { subsec_ = digits; }
 
         // NEW: configure default log location
         void set_log_directory(const std::string& dir) { log_dir_ = dir; }
@@ -287,88 +3016,718 @@ namespace tinylog {
             return p.string();
         }
 
-        void add_sink(const sink_ptr& s) { std::lock_guard<std::mutex> lk(mtx_); sinks_.push_back(s); }
-        void add_console_sink(bool color = true) { add_sink(std::make_shared<ConsoleSink>(color, utc_)); }
+        void add_sink(const sink_ptr& s) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            std::unique_ptr<SinkList> next(new SinkList(*sink_list()));
+            next->sinks.push_back(s);
+            sinks_.store(next.get(), std::memory_order_release);
+            lists_.emplace_back(std::move(next));
+            refresh_levels_locked();
+        }
+        void add_console_sink(bool color = true) { add_sink(std::make_shared<ConsoleSink>(color, utc_, subsec_)); }
+
+        // Blocks until everything logged before the call has reached the sinks (async: queues
+        // empty and the worker idle), then flushes them. An AsyncSink's own queue: AsyncSink::drain().
+        void flush() {
+#if TINYLOG_ASYNC
+            if (running_.load())
+                while (!queues_empty() || busy_.load()) { sig_.notify(); std::this_thread::yield(); }
+#endif
+            flush_sinks();
+        }
+
+        // Snapshot of the self-metrics (relaxed reads, so counters may be mid-update relative to
+        // each other). Export with format_prometheus() or read the fields directly.
+        LoggerStats stats() {
+            LoggerStats st;
+            uint64_t direct = dispatched_.value();
+            st.enqueued = enqueued_.value() + direct;
+            st.dispatched = direct + batched_.load(std::memory_order_relaxed);
+#if TINYLOG_ASYNC
+            st.dropped = dropped_count();
+            st.queue_depth = running_.load() ? queue_depth() : 0;
+            st.queue_high_water = high_water_.load(std::memory_order_relaxed);
+#endif
+            for (auto& s : sink_list()->sinks) {
+                const SinkCounters& c = s->stats_counters();
+                SinkStats x{ s.get(), c.bytes.load(std::memory_order_relaxed), c.rotations.load(std::memory_order_relaxed),
+                             c.rotate_ns.load(std::memory_order_relaxed), c.dropped.load(std::memory_order_relaxed), {},
+                             c.latency_ns.load(std::memory_order_relaxed) };
+                for (int k = 0; k < SinkCounters::buckets; ++k) x.latency[k] = c.latency[k].load(std::memory_order_relaxed);
+                st.sinks.push_back(x);
+            }
+            return st;
+        }
+
+#if !defined(_WIN32)
+        // On SIGSEGV/SIGABRT/SIGBUS/SIGFPE/SIGILL, write out what sinks still buffer and what the
+        // async queues still hold, for every logger (all built-in sinks; crash lines are in UTC), then re-raise
+        // to the previous handler. Best effort: the process state is whatever the crash left.
+        // The calling thread also gets an alternate stack, so stack overflows are covered there.
+        void install_crash_handler() {
+            static char alt[64 * 1024];
+            stack_t ss{}; ss.ss_sp = alt; ss.ss_size = sizeof(alt);
+            sigaltstack(&ss, nullptr);
+            struct sigaction sa{};
+            sa.sa_handler = &Logger::on_crash;
+            sigemptyset(&sa.sa_mask);
+            sa.sa_flags = SA_ONSTACK;
+            for (int i = 0; i < 5; ++i) sigaction(crash_signals_[i], &sa, &crash_prev()[i]);
+        }
+#endif
+
+        // File buffering for sinks added afterwards: write once `bytes` are pending, `interval`
+        // has passed, or a message at `flush_level` or above arrives.
+        void set_file_flush(size_t bytes, std::chrono::milliseconds interval, int flush_level = level::error) {
+            file_flush_bytes_ = bytes; file_flush_interval_ = interval; file_flush_level_ = flush_level;
+        }
+        // compression::none / gzip for files rotated by sinks added afterwards (needs TINYLOG_ZLIB).
+        void set_file_compression(int c) { file_compression_ = c; }
 
         // Original explicit path API (unchanged)
         void add_file_sink(const std::string& path, size_t max_bytes = 5 * 1024 * 1024, int max_files = 3) {
-            add_sink(std::make_shared<FileSink>(path, max_bytes, max_files, utc_));
+            auto f = std::make_shared<FileSink>(path, max_bytes, max_files, utc_, subsec_);
+            f->set_flush_policy(file_flush_bytes_, file_flush_interval_, file_flush_level_);
+            f->set_compression(file_compression_);
+            add_sink(f);
         }
 
         // NEW: uses configured dir/base/ext to build the path (e.g., logs/TinyLog.tiny)
         void add_default_file_sink(size_t max_bytes = 5 * 1024 * 1024, int max_files = 3) {
-            add_sink(std::make_shared<FileSink>(default_log_path(), max_bytes, max_files, utc_));
+            add_file_sink(default_log_path(), max_bytes, max_files);
+        }
+
+        // Compact binary records; decode with tinylog-decode (Tools/Decode).
+        void add_binary_file_sink(const std::string& path, size_t max_bytes = 64 * 1024 * 1024, int max_files = 3) {
+            auto f = std::make_shared<BinaryFileSink>(path, max_bytes, max_files, utc_, subsec_);
+            f->set_flush_policy(file_flush_bytes_, file_flush_interval_, file_flush_level_);
+            f->set_compression(file_compression_);
+            add_sink(f);
         }
 
+        // NDJSON, one object per message with kv() fields as members.
+        void add_json_file_sink(const std::string& path, size_t max_bytes = 64 * 1024 * 1024, int max_files = 3) {
+            auto f = std::make_shared<JsonSink>(path, max_bytes, max_files, utc_, subsec_ ? subsec_ : (int)time_precision::ms);
+            f->set_flush_policy(file_flush_bytes_, file_flush_interval_, file_flush_level_);
+            f->set_compression(file_compression_);
+            add_sink(f);
+        }
+
+#if !defined(_WIN32)
+        // Memory-mapped segments: path.1, path.2, ... each segment_bytes long; keeps max_files.
+        void add_mmap_file_sink(const std::string& path, size_t segment_bytes = 64 * 1024 * 1024, int max_files = 3) {
+            add_sink(std::make_shared<MmapFileSink>(path, segment_bytes, max_files, utc_, subsec_));
+        }
+#endif
+
 #if TINYLOG_ASYNC
-        void start_async() { if (running_) return; running_ = true; worker_ = std::thread([this] { LogMessage m; while (running_) { if (!q_.pop(m)) break; dispatch(m); } }); }
+        // Queue shape; set before start_async(). In per_thread mode the capacity is per thread.
+        void set_async_capacity(size_t n) { async_capacity_ = n; }
+        void set_overflow_policy(int p) { overflow_ = p; }
+        void set_async_mode(int mode) { if (!running_) async_mode_ = mode; }
+        uint64_t dropped_count() {
+            uint64_t n = retired_drops_.load(std::memory_order_relaxed);
+            if (q_) n += q_->dropped();
+            std::lock_guard<std::mutex> lk(rings_mtx_);
+            for (auto& r : rings_) n += r->dropped();
+            return n;
+        }
+
+        // Worker placement, set before start_async(): pin it to these CPUs, or to the CPUs of a
+        // NUMA node (Linux). The worker then allocates the shared queue itself, so the pages
+        // come from its node (first touch). worker_pinned() reports whether pinning took.
+        void set_worker_affinity(std::vector<int> cpus) { if (!running_) worker_cpus_ = std::move(cpus); }
+        void set_worker_numa_node(int node) { set_worker_affinity(numa_node_cpus(node)); }
+        bool worker_pinned() const { return worker_pinned_.load(); }
+
+        // How the worker waits, set before start_async(). It spins for `spin` (default: 128
+        // yields) before parking. A parked worker wakes for every `batch`-th message, for one
+        // at `wake_level` or above, for flush(), or after `max_delay` at the latest.
+        void set_worker_wakeup(std::chrono::microseconds spin, size_t batch = 1,
+                               std::chrono::milliseconds max_delay = std::chrono::milliseconds(50), int wake_level = level::error) {
+            if (running_) return;
+            sig_.set_wakeup(spin, batch);
+            wake_max_delay_ = max_delay; wake_level_ = wake_level;
+        }
+
+        void start_async() {
+            if (running_) return;
+            std::atomic<bool> ready{ false };
+            worker_ = std::thread([this, &ready] {
+                worker_pinned_.store(!worker_cpus_.empty() && pin_thread(worker_cpus_));
+                if (async_mode_ == async_mode::shared) q_.reset(new MPSCQueue(async_capacity_, overflow_, &sig_));
+                ready.store(true, std::memory_order_release);
+                while (!running_.load(std::memory_order_acquire)) std::this_thread::yield();
+                worker_loop();
+            });
+            while (!ready.load(std::memory_order_acquire)) std::this_thread::yield();
+            running_.store(true, std::memory_order_release);
+        }
 #endif
 
+        // Stable CallSite for callers that only have file/line/func at runtime (slow path:
+        // one map lookup under a mutex). The strings must outlive the logger, as before.
+        const CallSite* intern_site(int lv, const char* file, int line, const char* func, SiteState** st = nullptr) {
+            std::lock_guard<std::mutex> lk(sites_mtx_);
+            auto& slot = interned_[std::make_tuple(file, line, func, lv)];
+            if (!slot) slot.reset(new Interned{ CallSite{ file, basename_of(file), func, line, lv }, {} });
+            if (st) *st = &slot->state;
+            return &slot->site;
+        }
+
+        // True if some sink would take a message at lv (global level and sink levels).
+        bool should_log(int lv) const { return lv >= threshold_.load(std::memory_order_relaxed); }
+
+        // LOG_* sites: on/off from the level thresholds and the site rules.
+        bool site_on(const CallSite* site, SiteState* st) {
+            unsigned char v = st->v.load(std::memory_order_relaxed);
+            if (v == site_state::unknown || st->owner.load(std::memory_order_relaxed) != this) return register_site(site, st);
+            return v == site_state::on;
+        }
+        // Turns LOG_* sites on or off at runtime, like Linux dynamic debug. The glob is matched
+        // against the site's file path, file name, function, and "file.cpp:line":
+        //   logger.set_site_enabled("net_*.cpp", true);     // trace/debug there despite set_level
+        //   logger.set_site_enabled("Parser::*", false);    // silence a function family
+        // A later rule for the same glob replaces the earlier one. On still needs a sink that
+        // takes the site's level.
+        void set_site_enabled(const std::string& glob, bool enabled) {
+            std::lock_guard<std::mutex> lk(sites_mtx_);
+            for (auto it = site_rules_.begin(); it != site_rules_.end(); ++it)
+                if (it->first == glob) { site_rules_.erase(it); break; }
+            site_rules_.emplace_back(glob, enabled);
+            refresh_sites_locked();
+        }
+        void clear_site_rules() {
+            std::lock_guard<std::mutex> lk(sites_mtx_);
+            site_rules_.clear();
+            refresh_sites_locked();
+        }
+        void refresh_levels() { std::lock_guard<std::mutex> lk(mtx_); refresh_levels_locked(); }
+
+        // LOG_*_RATE: a message the rate limit turned away.
+        void suppress(const CallSite* site, SiteLimiter* lim) {
+            lim->suppressed.fetch_add(1, std::memory_order_relaxed);
+            track_limiter(site, lim);
+        }
+        // LOG_*_RATE: a message the rate limit let through. Identical repeats (same captured args)
+        // are folded into a count; pending counts are logged before the next distinct message.
+        template<class... Ts>
+        void submit_folded(const CallSite* site, SiteLimiter* lim, Ts&&... ts) {
+            ArgPack a; uint64_t h = a.capture(ts...) ? fnv1a(a.data(), a.size()) : 0;
+            if (lim->last_hash.exchange(h, std::memory_order_relaxed) == h && h) {
+                lim->repeats.fetch_add(1, std::memory_order_relaxed);
+                track_limiter(site, lim);
+                return;
+            }
+            report_limiter(site, lim, false);
+            submit(site, std::forward<Ts>(ts)...);
+        }
+        // Logs the pending "repeated"/"suppressed" counts of every rate-limited site now. They are
+        // also logged about once a second: by the async worker, or in sync mode from the
+        // maintenance thread.
+        void report_suppressed() { report_all(false); }
+
+        // LOG_SCOPE_STATS: one duration. The summaries are logged off the recording thread, by
+        // the async worker or (sync mode) the maintenance thread, once the interval has passed.
+        void record_scope(ScopeStats& st, uint64_t ns, uint64_t end_ns) {
+            st.record(ns);
+            if (st.tracked.load(std::memory_order_relaxed) || st.tracked.exchange(true)) return;
+            { std::lock_guard<std::mutex> lk(sites_mtx_); scopes_.push_back(&st); }
+            uint64_t due = 0, iv = scope_interval_ns_.load(std::memory_order_relaxed);
+            scope_due_ns_.compare_exchange_strong(due, end_ns + (iv ? iv : ~0ull / 2));
+            start_report_tick();
+        }
+        void maybe_report_scopes(bool direct) {
+            uint64_t due = scope_due_ns_.load(std::memory_order_relaxed);
+            if (due == 0) return;
+            uint64_t now = log_time_ns();
+            if (now < due) return;
+            uint64_t iv = scope_interval_ns_.load(std::memory_order_relaxed);
+            if (iv && scope_due_ns_.compare_exchange_strong(due, now + iv)) report_scopes(direct);
+        }
+        // How often LOG_SCOPE_STATS summaries are logged (0: only by report_scope_stats()).
+        void set_scope_stats_interval(std::chrono::milliseconds interval) {
+            uint64_t iv = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+            scope_interval_ns_.store(iv, std::memory_order_relaxed);
+            scope_due_ns_.store(log_time_ns() + (iv ? iv : ~0ull / 2), std::memory_order_relaxed);
+        }
+        // Logs one line per LOG_SCOPE_STATS site that ran since the last report, from the site
+        // itself, and starts a new interval:
+        //   scope parse n=1200 avg_ns=5300 min_ns=2100 p50_ns=8192 p99_ns=32768 max_ns=30500
+        // (percentiles are bucket upper bounds, capped at max). Sites the level or the site rules
+        // turn off are reset without a line.
+        void report_scope_stats() { report_scopes(false); }
+        void report_scopes(bool direct) {
+            std::vector<ScopeStats*> scopes;
+            { std::lock_guard<std::mutex> lk(sites_mtx_); scopes = scopes_; }
+            for (ScopeStats* st : scopes) {
+                uint64_t n = st->count.exchange(0, std::memory_order_relaxed);
+                if (!n) continue;
+                uint64_t sum = st->sum_ns.exchange(0, std::memory_order_relaxed);
+                uint64_t lo = st->min_ns.exchange(~0ull, std::memory_order_relaxed);
+                uint64_t hi = st->max_ns.exchange(0, std::memory_order_relaxed);
+                uint64_t h[ScopeStats::buckets], total = 0;
+                for (int i = 0; i < ScopeStats::buckets; ++i) total += (h[i] = st->hist[i].exchange(0, std::memory_order_relaxed));
+                auto pct = [&](double p) {
+                    uint64_t want = (uint64_t)(p * (double)total), seen = 0;
+                    for (int i = 0; i < ScopeStats::buckets; ++i)
+                        if ((seen += h[i]) > want) return std::min<uint64_t>(2ull << i, hi);
+                    return hi;
+                };
+                if (st->state ? site_on(st->site, st->state) : should_log(st->site->level))
+                    emit(st->site, direct, "scope ", st->name, kv("n", n), kv("avg_ns", sum / n), kv("min_ns", lo),
+                         kv("p50_ns", pct(0.50)), kv("p99_ns", pct(0.99)), kv("max_ns", hi));
+            }
+        }
+
+        // Runtime-level path: the interned site carries its own state, so site rules apply as
+        // for LOG_AT. Below every sink's level it returns before the lookup.
         template<class... Ts>
         void log(int lv, const char* file, int line, const char* func, Ts&&... ts) {
-            if (lv < level_.load(std::memory_order_relaxed)) return;
-            LogMessage m; m.level = lv; m.ts_ns = now_ns(); m.wall = std::time(nullptr); m.tid = std::this_thread::get_id(); m.file = file; m.line = line; m.func = func; m.text = cat(std::forward<Ts>(ts)...);
+            if (lv < sink_floor_.load(std::memory_order_relaxed)) return;
+            SiteState* st = nullptr;
+            const CallSite* site = intern_site(lv, file, line, func, &st);
+            if (site_on(site, st)) submit(site, std::forward<Ts>(ts)...);
+        }
+        // LOG_AT_LEVEL: as above, but the call site caches the interned site per level, so only
+        // the first message at each level takes the lock.
+        template<class... Ts>
+        void log(LevelSites& c, int lv, const char* file, int line, const char* func, Ts&&... ts) {
+            if (lv < sink_floor_.load(std::memory_order_relaxed)) return;
+            if (lv < 0 || lv >= level::off) { log(lv, file, line, func, std::forward<Ts>(ts)...); return; }
+            const CallSite* site = c.site[lv].load(std::memory_order_acquire);
+            if (!site) { site = intern_site(lv, file, line, func); c.site[lv].store(site, std::memory_order_release); }
+            if (site_on(site, &c.state[lv])) submit(site, std::forward<Ts>(ts)...);
+        }
+
+        template<class... Ts>
+        void log(const CallSite* site, Ts&&... ts) {
+            if (should_log(site->level)) submit(site, std::forward<Ts>(ts)...);
+        }
+
+        // Logs without the level check; LOG_* macros call it once their site is enabled.
+        // LOG_*F: the format's segments interleaved with the arguments, then submit() as usual.
+        template<size_t N, class... Ts>
+        void submit_fmt(const CallSite* site, const FmtString<N>& f, const char (&)[N], Ts&&... ts) {
+            submit_interleaved(site, f, std::forward_as_tuple(std::forward<Ts>(ts)...), std::make_index_sequence<2 * sizeof...(Ts) + 1>());
+        }
+        template<size_t N, class Tup, size_t... J>
+        void submit_interleaved(const CallSite* site, const FmtString<N>& f, Tup&& args, std::index_sequence<J...>) {
+            auto pick = [&](auto j) -> decltype(auto) {
+                constexpr size_t i = decltype(j)::value;
+                if constexpr (i % 2 == 0) return f.seg(i / 2); else return std::get<i / 2>(args);
+            };
+            submit(site, pick(std::integral_constant<size_t, J>())...);
+        }
+
+        template<class... Ts>
+        void submit(const CallSite* site, Ts&&... ts) {
+            int lv = site->level;
+            LogMessage m; m.level = lv; m.ts_ns = log_time_ns(); m.wall = (std::time_t)(m.ts_ns / 1000000000ull); m.tid = std::this_thread::get_id(); m.site = site;
 #if TINYLOG_ASYNC
-            if (running_) { q_.push(std::move(m)); return; }
+            if (running_.load(std::memory_order_acquire)) {
+                enqueued_.add();
+                // Copy the raw arguments; the worker formats them. Oversized argument lists fall back to cat().
+                if (!m.args.capture(std::forward<Ts>(ts)...)) { FmtBuf b; cat_into(b, std::forward<Ts>(ts)...); m.text.assign(b.data(), b.size()); }
+                if (async_mode_ == async_mode::per_thread) thread_ring().push(std::move(m)); else q_->push(std::move(m));
+                sig_.notify(lv >= wake_level_);
+                return;
+            }
 #endif
+            // Capture the raw arguments when an args-only sink (binary, JSON) takes this level, or
+            // when no text sink does; text sinks then get it rendered from the capture in dispatch.
+            bool args = lv >= args_floor_.load(std::memory_order_relaxed) || lv < text_floor_.load(std::memory_order_relaxed);
+            if (!args || !m.args.capture(std::forward<Ts>(ts)...)) {
+                FmtBuf b; cat_into(b, std::forward<Ts>(ts)...); m.text.assign(b.data(), b.size());
+            }
             dispatch(m);
         }
 
     private:
-        void dispatch(const LogMessage& m) { std::lock_guard<std::mutex> lk(mtx_); for (auto& s : sinks_) s->write(m); }
+        static uint64_t fnv1a(const unsigned char* p, size_t n) {
+            uint64_t h = 1469598103934665603ull;
+            for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 1099511628211ull; }
+            return h | 1;   // never 0 (0 means "not captured")
+        }
+        // direct: dispatch on this thread instead of queueing (for the async worker itself).
+        void report_limiter(const CallSite* site, SiteLimiter* lim, bool direct) {
+            uint64_t r = lim->repeats.exchange(0, std::memory_order_relaxed);
+            uint64_t d = lim->suppressed.exchange(0, std::memory_order_relaxed);
+            if (r) emit_note(site, direct, cat("last message repeated ", r, " times"));
+            if (d) emit_note(site, direct, cat(d, " messages suppressed (rate limit)"));
+        }
+        void report_all(bool direct) {
+            std::vector<std::pair<const CallSite*, SiteLimiter*>> lims;
+            { std::lock_guard<std::mutex> lk(sites_mtx_); lims = limiters_; }
+            for (auto& l : lims) report_limiter(l.first, l.second, direct);
+        }
+        // Logs ts from a report: the async worker dispatches them itself instead of queueing.
+        template<class... Ts> void emit(const CallSite* site, bool direct, Ts&&... ts) {
+            if (!direct) { submit(site, std::forward<Ts>(ts)...); return; }
+            LogMessage m; m.level = site->level; m.ts_ns = log_time_ns(); m.wall = (std::time_t)(m.ts_ns / 1000000000ull);
+            m.tid = std::this_thread::get_id(); m.site = site;
+            if (!m.args.capture(ts...)) m.text = cat(ts...);
+            dispatch(m);
+        }
+        void emit_note(const CallSite* site, bool direct, std::string text) {
+            if (!direct) { submit(site, text); return; }
+            LogMessage m; m.level = site->level; m.ts_ns = log_time_ns(); m.wall = (std::time_t)(m.ts_ns / 1000000000ull);
+            m.tid = std::this_thread::get_id(); m.site = site; m.text = std::move(text);
+            dispatch(m);
+        }
+        const SinkList* sink_list() const { return sinks_.load(std::memory_order_acquire); }
+        void flush_sinks() { for (auto& s : sink_list()->sinks) s->flush(); }
+        void refresh_levels_locked() {
+            auto sl = sink_list();
+            int floor = sl->sinks.empty() ? (int)level::trace : (int)level::off, text = level::off, args = level::off;
+            for (auto& s : sl->sinks) {
+                floor = std::min(floor, s->level());
+                if (s->wants_text()) text = std::min(text, s->level()); else args = std::min(args, s->level());
+            }
+            threshold_.store(std::max(level_.load(std::memory_order_relaxed), floor), std::memory_order_relaxed);
+            sink_floor_.store(floor, std::memory_order_relaxed);
+            text_floor_.store(text, std::memory_order_relaxed);
+            args_floor_.store(args, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lk(sites_mtx_);
+            refresh_sites_locked();
+        }
+        static int line_sinks(const SinkList& sl, int lv) {
+            int n = 0;
+            for (auto& s : sl.sinks) n += (lv >= s->level() && s->wants_line());
+            return n;
+        }
+        void set_line(LogMessage& m, std::string_view l) { m.line = l; m.line_utc = utc_; m.line_subsec = subsec_; }
+
+        void dispatch(LogMessage& m) {
+            auto sl = sink_list();
+            // Format once when several sinks would each format the same line.
+            FmtBuf line;
+            if (line_sinks(*sl, m.level) >= 2) {
+                if (m.text.empty()) m.render_text();
+                format_line(m, utc_, line, false, subsec_);
+                set_line(m, line.view());
+            }
+            // Write latency is sampled: every 16th message per thread is timed.
+            static thread_local unsigned tick = 0;
+            bool timed = (++tick & 15) == 0;
+            for (auto& s : sl->sinks) {
+                if (m.level < s->level()) continue;
+                // Deferred args are rendered on first use (a text sink may also have been added
+                // or lowered its level after m was captured).
+                if (m.text.empty() && s->wants_text()) m.render_text();
+                if (!timed) { s->write(m); continue; }
+                auto t0 = std::chrono::steady_clock::now();
+                s->write(m);
+                s->counters().add_latency(elapsed_ns(t0));
+            }
+            m.line = {};
+            dispatched_.add();
+        }
+        static uint64_t elapsed_ns(std::chrono::steady_clock::time_point t0) {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        }
+        // Each sink gets the runs of the batch at or above its level, so batching survives filtering.
+        void dispatch_batch(std::vector<LogMessage>& batch) {
+            auto sl = sink_list();
+            int text = level::off;
+            for (auto& s : sl->sinks) if (s->wants_text()) text = std::min(text, s->level());
+            for (auto& m : batch) if (m.level >= text && m.text.empty()) m.render_text();
+            // Shared lines for the whole batch go into one buffer; views are taken once it has
+            // stopped growing.
+            lines_.clear(); line_ends_.clear();
+            for (auto& m : batch) {
+                if (line_sinks(*sl, m.level) >= 2) format_line(m, utc_, lines_, false, subsec_);
+                line_ends_.push_back(lines_.size());
+            }
+            if (lines_.size()) {
+                size_t at = 0;
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    set_line(batch[i], std::string_view(lines_.data() + at, line_ends_[i] - at));
+                    at = line_ends_[i];
+                }
+            }
+            for (auto& s : sl->sinks) {
+                int lv = s->level();
+                for (size_t i = 0, n = batch.size(); i < n;) {
+                    if (batch[i].level < lv) { ++i; continue; }
+                    size_t j = i + 1; while (j < n && batch[j].level >= lv) ++j;
+                    auto t0 = std::chrono::steady_clock::now();
+                    s->write_batch(MessageSpan{ batch.data() + i, j - i });
+                    s->counters().add_latency(elapsed_ns(t0));
+                    i = j;
+                }
+            }
+            if (lines_.size()) for (auto& m : batch) m.line = {};
+            batched_.store(batched_.load(std::memory_order_relaxed) + batch.size(), std::memory_order_relaxed);  // worker only
+        }
     };
 
+    inline void sink_levels_changed() {
+        auto& r = Logger::registry();
+        std::lock_guard<std::mutex> lk(r.mtx);
+        for (Logger* l : r.all) l->refresh_levels();
+    }
+
     // ---------- Scope Timer ----------
+    // Literal names are kept as a pointer; anything else is copied, and only if the site is on.
     class ScopeTimer {
-        const char* file_; const char* func_; int line_; int lv_; std::string name_;
+        const CallSite* site_;
+        const char* lit_ = nullptr; std::string name_;
+        bool active_;
         std::chrono::high_resolution_clock::time_point start_;
     public:
-        ScopeTimer(const char* file, int line, const char* func, int level, std::string name)
-            : file_(file), func_(func), line_(line), lv_(level), name_(std::move(name)), start_(std::chrono::high_resolution_clock::now()) {
+        ScopeTimer(const CallSite* site, std::string_view name, SiteState* st = nullptr)
+            : site_(site), active_(st ? Logger::instance().site_on(site, st) : Logger::instance().should_log(site->level)) {
+            if (!active_) return;
+            name_.assign(name.data(), name.size());
+            start_ = std::chrono::high_resolution_clock::now();
+        }
+        template<size_t N>
+        ScopeTimer(const CallSite* site, const char (&name)[N], SiteState* st = nullptr)
+            : site_(site), lit_(name), active_(st ? Logger::instance().site_on(site, st) : Logger::instance().should_log(site->level)) {
+            if (active_) start_ = std::chrono::high_resolution_clock::now();
+        }
+        ScopeTimer(const char* file, int line, const char* func, int level, std::string_view name)
+            : ScopeTimer(Logger::instance().intern_site(level, file, line, func), name) {
         }
         ~ScopeTimer() {
+            if (!active_) return;
             using namespace std::chrono;
             auto end = high_resolution_clock::now();
             auto us = duration_cast<microseconds>(end - start_).count();
-            Logger::instance().log(lv_, file_, line_, func_, name_, " took ", us, "us");
+            if (lit_) Logger::instance().submit(site_, lit_, " took ", us, "us");
+            else Logger::instance().submit(site_, name_, " took ", us, "us");
+        }
+    };
+
+    // LOG_SCOPE_STATS: records the scope's duration instead of logging it.
+    class ScopeStatsTimer {
+        ScopeStats* st_;
+        uint64_t start_;
+    public:
+        ScopeStatsTimer(ScopeStats* st, bool on) : st_(on ? st : nullptr), start_(on ? log_time_ns() : 0) {}
+        ~ScopeStatsTimer() {
+            if (!st_) return;
+            uint64_t end = log_time_ns();   // the TSC clock under TINYLOG_TSC
+            Logger::instance().record_scope(*st_, end > start_ ? end - start_ : 0, end);
         }
     };
 
     // ---------- Macros ----------
-#define LOG_AT(lv, ...) tinylog::Logger::instance().log(lv, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define TINYLOG_SITE(lv) { __FILE__, ::tinylog::basename_of(__FILE__), __func__, __LINE__, lv }
+
+// The arguments are only evaluated once the site is known to be enabled. Disabled sites stop
+// at the first test: one relaxed load of _tl_state and a branch.
+#define LOG_AT(lv, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; \
+        if (_tl_state.v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && \
+            ::tinylog::Logger::instance().site_on(&_tl_site, &_tl_state)) \
+            ::tinylog::Logger::instance().submit(&_tl_site, __VA_ARGS__); \
+    } while (0)
 
-#if TINYLOG_LEVEL <= tinylog::level::trace
+// LOG_AT takes a constant level and is a statement. For a level only known at runtime, or where
+// an expression is needed, LOG_AT_LEVEL interns the site instead. The first call at each level
+// looks it up under a mutex; later calls use the per-call-site cache (one acquire load).
+#define LOG_AT_LEVEL(lv, ...) ([&](const char* _tl_func) { \
+        static ::tinylog::LevelSites _tl_sites; \
+        ::tinylog::Logger::instance().log(_tl_sites, (int)(lv), __FILE__, __LINE__, _tl_func, __VA_ARGS__); \
+    }(__func__))
+
+// LOG_AT for a named logger: LOG_INFO_TO(net, "peer ", id) with net = Logger::get("net") kept
+// in a reference. The logger expression is evaluated on every execution, so do not call get()
+// in it. The site's state is cached for the first logger it runs with; with any other logger
+// the statement takes register_site()'s slow path (mutex + rule matching) on every call, so
+// each statement should target one logger.
+#define LOG_AT_TO(logger, lv, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; \
+        ::tinylog::Logger& _tl_lg = (logger); \
+        if (_tl_lg.site_on(&_tl_site, &_tl_state)) _tl_lg.submit(&_tl_site, __VA_ARGS__); \
+    } while (0)
+
+// Format-string form: LOG_INFOF("user {} took {}us", id, us). The format must be a string
+// literal; it is parsed at compile time and a bad brace or an argument count that does not
+// match the {} slots fails the build.
+#define TINYLOG_EXPAND(x) x
+#define TINYLOG_FIRST_(f, ...) f
+#define TINYLOG_FIRST(...) TINYLOG_EXPAND(TINYLOG_FIRST_(__VA_ARGS__, 0))
+#define LOG_ATF(lv, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; \
+        static constexpr ::tinylog::FmtString<sizeof(TINYLOG_FIRST(__VA_ARGS__))> _tl_fmt{ TINYLOG_FIRST(__VA_ARGS__) }; \
+        static_assert(_tl_fmt.ok, "LOG_*F: stray brace in format (use {} for arguments, {{ and }} for braces)"); \
+        static_assert(_tl_fmt.slots() + 1 == sizeof(::tinylog::fmt_arity(__VA_ARGS__)), "LOG_*F: argument count does not match the {} in the format"); \
+        if (_tl_state.v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && \
+            ::tinylog::Logger::instance().site_on(&_tl_site, &_tl_state)) \
+            ::tinylog::Logger::instance().submit_fmt(&_tl_site, _tl_fmt, __VA_ARGS__); \
+    } while (0)
+
+#if TINYLOG_LEVEL <= 0 // trace
 #  define LOG_TRACE(...) LOG_AT(tinylog::level::trace, __VA_ARGS__)
+#  define LOG_TRACE_EVERY_N(n, ...) LOG_AT_EVERY_N(tinylog::level::trace, n, __VA_ARGS__)
+#  define LOG_TRACE_RATE(per_sec, ...) LOG_AT_RATE(tinylog::level::trace, per_sec, __VA_ARGS__)
+#  define LOG_TRACE_SAMPLED(p, ...) LOG_AT_SAMPLED(tinylog::level::trace, p, __VA_ARGS__)
+#  define LOG_TRACE_SAMPLE_N(n, ...) LOG_AT_SAMPLE_N(tinylog::level::trace, n, __VA_ARGS__)
+#  define LOG_TRACE_TO(logger, ...) LOG_AT_TO(logger, tinylog::level::trace, __VA_ARGS__)
+#  define LOG_TRACEF(...) LOG_ATF(tinylog::level::trace, __VA_ARGS__)
 #else
 #  define LOG_TRACE(...) (void)0
+#  define LOG_TRACE_EVERY_N(n, ...) (void)0
+#  define LOG_TRACE_RATE(per_sec, ...) (void)0
+#  define LOG_TRACE_SAMPLED(p, ...) (void)0
+#  define LOG_TRACE_SAMPLE_N(n, ...) (void)0
+#  define LOG_TRACE_TO(logger, ...) (void)0
+#  define LOG_TRACEF(...) (void)0
 #endif
-#if TINYLOG_LEVEL <= tinylog::level::debug
+#if TINYLOG_LEVEL <= 1 // debug
 #  define LOG_DEBUG(...) LOG_AT(tinylog::level::debug, __VA_ARGS__)
+#  define LOG_DEBUG_EVERY_N(n, ...) LOG_AT_EVERY_N(tinylog::level::debug, n, __VA_ARGS__)
+#  define LOG_DEBUG_RATE(per_sec, ...) LOG_AT_RATE(tinylog::level::debug, per_sec, __VA_ARGS__)
+#  define LOG_DEBUG_SAMPLED(p, ...) LOG_AT_SAMPLED(tinylog::level::debug, p, __VA_ARGS__)
+#  define LOG_DEBUG_SAMPLE_N(n, ...) LOG_AT_SAMPLE_N(tinylog::level::debug, n, __VA_ARGS__)
+#  define LOG_DEBUG_TO(logger, ...) LOG_AT_TO(logger, tinylog::level::debug, __VA_ARGS__)
+#  define LOG_DEBUGF(...) LOG_ATF(tinylog::level::debug, __VA_ARGS__)
 #else
 #  define LOG_DEBUG(...) (void)0
+#  define LOG_DEBUG_EVERY_N(n, ...) (void)0
+#  define LOG_DEBUG_RATE(per_sec, ...) (void)0
+#  define LOG_DEBUG_SAMPLED(p, ...) (void)0
+#  define LOG_DEBUG_SAMPLE_N(n, ...) (void)0
+#  define LOG_DEBUG_TO(logger, ...) (void)0
+#  define LOG_DEBUGF(...) (void)0
 #endif
-#if TINYLOG_LEVEL <= tinylog::level::info
+#if TINYLOG_LEVEL <= 2 // info
 #  define LOG_INFO(...)  LOG_AT(tinylog::level::info,  __VA_ARGS__)
+#  define LOG_INFO_EVERY_N(n, ...) LOG_AT_EVERY_N(tinylog::level::info, n, __VA_ARGS__)
+#  define LOG_INFO_RATE(per_sec, ...) LOG_AT_RATE(tinylog::level::info, per_sec, __VA_ARGS__)
+#  define LOG_INFO_SAMPLED(p, ...) LOG_AT_SAMPLED(tinylog::level::info, p, __VA_ARGS__)
+#  define LOG_INFO_SAMPLE_N(n, ...) LOG_AT_SAMPLE_N(tinylog::level::info, n, __VA_ARGS__)
+#  define LOG_INFO_TO(logger, ...) LOG_AT_TO(logger, tinylog::level::info, __VA_ARGS__)
+#  define LOG_INFOF(...) LOG_ATF(tinylog::level::info, __VA_ARGS__)
 #else
 #  define LOG_INFO(...) (void)0
+#  define LOG_INFO_EVERY_N(n, ...) (void)0
+#  define LOG_INFO_RATE(per_sec, ...) (void)0
+#  define LOG_INFO_SAMPLED(p, ...) (void)0
+#  define LOG_INFO_SAMPLE_N(n, ...) (void)0
+#  define LOG_INFO_TO(logger, ...) (void)0
+#  define LOG_INFOF(...) (void)0
 #endif
-#if TINYLOG_LEVEL <= tinylog::level::warn
+#if TINYLOG_LEVEL <= 3 // warn
 #  define LOG_WARN(...)  LOG_AT(tinylog::level::warn,  __VA_ARGS__)
+#  define LOG_WARN_EVERY_N(n, ...) LOG_AT_EVERY_N(tinylog::level::warn, n, __VA_ARGS__)
+#  define LOG_WARN_RATE(per_sec, ...) LOG_AT_RATE(tinylog::level::warn, per_sec, __VA_ARGS__)
+#  define LOG_WARN_SAMPLED(p, ...) LOG_AT_SAMPLED(tinylog::level::warn, p, __VA_ARGS__)
+#  define LOG_WARN_SAMPLE_N(n, ...) LOG_AT_SAMPLE_N(tinylog::level::warn, n, __VA_ARGS__)
+#  define LOG_WARN_TO(logger, ...) LOG_AT_TO(logger, tinylog::level::warn, __VA_ARGS__)
+#  define LOG_WARNF(...) LOG_ATF(tinylog::level::warn, __VA_ARGS__)
 #else
 #  define LOG_WARN(...) (void)0
+#  define LOG_WARN_EVERY_N(n, ...) (void)0
+#  define LOG_WARN_RATE(per_sec, ...) (void)0
+#  define LOG_WARN_SAMPLED(p, ...) (void)0
+#  define LOG_WARN_SAMPLE_N(n, ...) (void)0
+#  define LOG_WARN_TO(logger, ...) (void)0
+#  define LOG_WARNF(...) (void)0
 #endif
-#if TINYLOG_LEVEL <= tinylog::level::error
+#if TINYLOG_LEVEL <= 4 // error
 #  define LOG_ERROR(...) LOG_AT(tinylog::level::error, __VA_ARGS__)
+#  define LOG_ERROR_EVERY_N(n, ...) LOG_AT_EVERY_N(tinylog::level::error, n, __VA_ARGS__)
+#  define LOG_ERROR_RATE(per_sec, ...) LOG_AT_RATE(tinylog::level::error, per_sec, __VA_ARGS__)
+#  define LOG_ERROR_SAMPLED(p, ...) LOG_AT_SAMPLED(tinylog::level::error, p, __VA_ARGS__)
+#  define LOG_ERROR_SAMPLE_N(n, ...) LOG_AT_SAMPLE_N(tinylog::level::error, n, __VA_ARGS__)
+#  define LOG_ERROR_TO(logger, ...) LOG_AT_TO(logger, tinylog::level::error, __VA_ARGS__)
+#  define LOG_ERRORF(...) LOG_ATF(tinylog::level::error, __VA_ARGS__)
 #else
 #  define LOG_ERROR(...) (void)0
+#  define LOG_ERROR_EVERY_N(n, ...) (void)0
+#  define LOG_ERROR_RATE(per_sec, ...) (void)0
+#  define LOG_ERROR_SAMPLED(p, ...) (void)0
+#  define LOG_ERROR_SAMPLE_N(n, ...) (void)0
+#  define LOG_ERROR_TO(logger, ...) (void)0
+#  define LOG_ERRORF(...) (void)0
 #endif
-#if TINYLOG_LEVEL <= tinylog::level::critical
+#if TINYLOG_LEVEL <= 5 // critical
 #  define LOG_CRIT(...)  LOG_AT(tinylog::level::critical, __VA_ARGS__)
+#  define LOG_CRIT_EVERY_N(n, ...) LOG_AT_EVERY_N(tinylog::level::critical, n, __VA_ARGS__)
+#  define LOG_CRIT_RATE(per_sec, ...) LOG_AT_RATE(tinylog::level::critical, per_sec, __VA_ARGS__)
+#  define LOG_CRIT_SAMPLED(p, ...) LOG_AT_SAMPLED(tinylog::level::critical, p, __VA_ARGS__)
+#  define LOG_CRIT_SAMPLE_N(n, ...) LOG_AT_SAMPLE_N(tinylog::level::critical, n, __VA_ARGS__)
+#  define LOG_CRIT_TO(logger, ...) LOG_AT_TO(logger, tinylog::level::critical, __VA_ARGS__)
+#  define LOG_CRITF(...) LOG_ATF(tinylog::level::critical, __VA_ARGS__)
 #else
 #  define LOG_CRIT(...) (void)0
+#  define LOG_CRIT_EVERY_N(n, ...) (void)0
+#  define LOG_CRIT_RATE(per_sec, ...) (void)0
+#  define LOG_CRIT_SAMPLED(p, ...) (void)0
+#  define LOG_CRIT_SAMPLE_N(n, ...) (void)0
+#  define LOG_CRIT_TO(logger, ...) (void)0
+#  define LOG_CRITF(...) (void)0
 #endif
 
-#define LOG_SCOPE(name) tinylog::ScopeTimer TINYLOG_UNIQUE_NAME(_tl_scope_){__FILE__,__LINE__,__func__, tinylog::level::debug, name}
+// Logs the 1st, (n+1)th, (2n+1)th ... execution of this statement.
+#define LOG_AT_EVERY_N(lv, n, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; static ::tinylog::SiteLimiter _tl_lim; \
+        if (_tl_state.v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && \
+            ::tinylog::Logger::instance().site_on(&_tl_site, &_tl_state) && _tl_lim.every_n(::tinylog::sample_period(n))) \
+            ::tinylog::Logger::instance().submit(&_tl_site, __VA_ARGS__); \
+    } while (0)
+
+// Probabilistic (LOG_*_SAMPLED: each execution with probability p) and deterministic
+// (LOG_*_SAMPLE_N: 1st, (n+1)th ... execution on each thread) sampling. Both decide with
+// thread-local state only, so unlike EVERY_N nothing is shared between request threads.
+// p is clamped to [0, 1]; for SAMPLE_N and EVERY_N an n of 0 or less means every execution.
+#define LOG_AT_SAMPLED(lv, p, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; \
+        if (_tl_state.v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && ::tinylog::sample(p) && \
+            ::tinylog::Logger::instance().site_on(&_tl_site, &_tl_state)) \
+            ::tinylog::Logger::instance().submit(&_tl_site, __VA_ARGS__); \
+    } while (0)
+#define LOG_AT_SAMPLE_N(lv, n, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; static thread_local uint64_t _tl_left = 0; \
+        if (_tl_state.v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && _tl_left-- == 0 && \
+            (_tl_left = ::tinylog::sample_period(n) - 1, ::tinylog::Logger::instance().site_on(&_tl_site, &_tl_state))) \
+            ::tinylog::Logger::instance().submit(&_tl_site, __VA_ARGS__); \
+    } while (0)
+
+// At most per_sec messages a second from this statement (bursts up to per_sec), checked before
+// the arguments are evaluated; identical consecutive messages are folded. The dropped and
+// folded counts are logged later from the same site.
+#define LOG_AT_RATE(lv, per_sec, ...) do { \
+        static constexpr ::tinylog::CallSite _tl_site TINYLOG_SITE(lv); \
+        static ::tinylog::SiteState _tl_state; static ::tinylog::SiteLimiter _tl_lim; \
+        if (_tl_state.v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && \
+            ::tinylog::Logger::instance().site_on(&_tl_site, &_tl_state)) { \
+            if (_tl_lim.rate(per_sec, ::tinylog::now_ns())) ::tinylog::Logger::instance().submit_folded(&_tl_site, &_tl_lim, __VA_ARGS__); \
+            else ::tinylog::Logger::instance().suppress(&_tl_site, &_tl_lim); \
+        } \
+    } while (0)
+
+// Calls fn() only if the site is enabled; its result is the message.
+//   LOG_LAZY(tinylog::level::debug, [&] { return expensive_dump(obj); });
+// (Every LOG_* already checks before evaluating its arguments; this is for work that doesn't
+// fit in an argument list.)
+#define LOG_LAZY(lv, fn) do { if ((lv) >= TINYLOG_LEVEL) LOG_AT(lv, (fn)()); } while (0)
+
+#define LOG_SCOPE(name) \
+    static constexpr ::tinylog::CallSite TINYLOG_UNIQUE_NAME(_tl_scope_site_) TINYLOG_SITE(tinylog::level::debug); \
+    static ::tinylog::SiteState TINYLOG_UNIQUE_NAME(_tl_scope_state_); \
+    tinylog::ScopeTimer TINYLOG_UNIQUE_NAME(_tl_scope_){&TINYLOG_UNIQUE_NAME(_tl_scope_site_), name, &TINYLOG_UNIQUE_NAME(_tl_scope_state_)}
+
+// Aggregated timing for hot scopes: durations go into a per-site histogram and a summary line
+// (info level, kv fields) is logged per interval (Logger::set_scope_stats_interval, default
+// 60 s) or on Logger::report_scope_stats(). name must be a string literal (checked).
+#define LOG_SCOPE_STATS(name) \
+    static constexpr ::tinylog::CallSite TINYLOG_UNIQUE_NAME(_tl_sstat_site_) TINYLOG_SITE(tinylog::level::info); \
+    static ::tinylog::SiteState TINYLOG_UNIQUE_NAME(_tl_sstat_state_); \
+    static ::tinylog::ScopeStats TINYLOG_UNIQUE_NAME(_tl_sstat_){ &TINYLOG_UNIQUE_NAME(_tl_sstat_site_), "" name, &TINYLOG_UNIQUE_NAME(_tl_sstat_state_) }; \
+    ::tinylog::ScopeStatsTimer TINYLOG_UNIQUE_NAME(_tl_sstat_timer_){ &TINYLOG_UNIQUE_NAME(_tl_sstat_), \
+        TINYLOG_UNIQUE_NAME(_tl_sstat_state_).v.load(std::memory_order_relaxed) != ::tinylog::site_state::off && \
+        ::tinylog::Logger::instance().site_on(&TINYLOG_UNIQUE_NAME(_tl_sstat_site_), &TINYLOG_UNIQUE_NAME(_tl_sstat_state_)) }
 
 // helper to create unique var name
 #define TINYLOG_CONCAT_INNER(a,b) a##b
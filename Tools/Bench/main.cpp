@@ -0,0 +1,156 @@
+// tinylog-bench: throughput and caller-side latency of LOG_INFO, one JSON line per case.
+//   g++ -std=c++17 -O2 -I. Tools/Bench/main.cpp -o tinylog-bench -lpthread
+//   g++ -std=c++17 -O2 -I. -DTINYLOG_ASYNC=1 Tools/Bench/main.cpp -o tinylog-bench-async -lpthread
+//   ./tinylog-bench > sync.jsonl                         # every case: threads x sink x message
+//   ./tinylog-bench --threads 4 --sink file --msg long   # a single case
+// Each case runs in its own process (the Logger is a singleton). Latency is per call, measured
+// with steady_clock around the macro, so it includes ~20 ns of clock overhead.
+#include "TinyLog/tinylog.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    struct NullSink : tinylog::LogSink {
+        void write(const tinylog::LogMessage&) override {}
+    };
+
+    struct Options {
+        int threads = 1;
+        std::string sink = "null";   // null, file, console
+        std::string msg = "short";   // short, long
+        long count = 400000;         // messages per case, split across threads
+        std::string dir = "bench_out";
+    };
+
+#if TINYLOG_ASYNC
+    const char* mode_name() { return "async"; }
+#else
+    const char* mode_name() { return "sync"; }
+#endif
+
+    // Keeps the results on the real stdout while the console sink logs to /dev/null.
+    int results_fd = 1;
+    void redirect_stdout() {
+#if defined(_WIN32)
+        results_fd = _dup(1);
+        int nul = _open("NUL", _O_WRONLY);
+        _dup2(nul, 1); _close(nul);
+#else
+        results_fd = ::dup(1);
+        int nul = ::open("/dev/null", O_WRONLY);
+        ::dup2(nul, 1); ::close(nul);
+#endif
+    }
+
+    uint64_t pct(const std::vector<uint32_t>& v, double p) {
+        if (v.empty()) return 0;
+        size_t i = (size_t)(p * (double)(v.size() - 1));
+        return v[i];
+    }
+
+    int run_case(const Options& o) {
+        auto& L = tinylog::Logger::instance();
+        if (o.sink == "null") L.add_sink(std::make_shared<NullSink>());
+        else if (o.sink == "file") {
+            std::error_code ec; fs::create_directories(o.dir, ec);
+            L.add_file_sink((fs::path(o.dir) / "bench.log").string(), 64 * 1024 * 1024, 2);
+        }
+        else if (o.sink == "console") { redirect_stdout(); L.add_console_sink(false); }
+        else { std::cerr << "unknown sink: " << o.sink << "\n"; return 2; }
+#if TINYLOG_ASYNC
+        L.set_async_capacity(64 * 1024);
+        L.start_async();
+#endif
+        const std::string payload(160, 'x');
+        const long per = o.count / o.threads;
+        std::vector<std::vector<uint32_t>> lat((size_t)o.threads);
+        std::atomic<int> ready{ 0 };
+        std::atomic<bool> go{ false };
+        std::vector<std::thread> th;
+        for (int t = 0; t < o.threads; ++t) {
+            th.emplace_back([&, t] {
+                auto& v = lat[(size_t)t]; v.reserve((size_t)per);
+                ready.fetch_add(1);
+                while (!go.load()) std::this_thread::yield();
+                for (long i = 0; i < per; ++i) {
+                    auto t0 = std::chrono::steady_clock::now();
+                    if (o.msg == "long") LOG_INFO("request done id=", i, " thread=", t, " user=alice path=/api/v1/items payload=", payload, " took_ms=", 12.5);
+                    else LOG_INFO("request done id=", i);
+                    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+                    v.push_back((uint32_t)std::min<long long>(ns, UINT32_MAX));
+                }
+            });
+        }
+        while (ready.load() < o.threads) std::this_thread::yield();
+        auto start = std::chrono::steady_clock::now();
+        go.store(true);
+        for (auto& x : th) x.join();
+        auto produced = std::chrono::steady_clock::now();
+        L.flush();
+        auto done = std::chrono::steady_clock::now();
+
+        std::vector<uint32_t> all;
+        for (auto& v : lat) all.insert(all.end(), v.begin(), v.end());
+        std::sort(all.begin(), all.end());
+        double caller_s = std::chrono::duration<double>(produced - start).count();
+        double total_s = std::chrono::duration<double>(done - start).count();
+        long n = per * o.threads;
+
+        tinylog::FmtBuf b;
+        b.append("{\"mode\":\""); b.append(mode_name());
+        b.append("\",\"threads\":"); b.append_int(o.threads);
+        b.append(",\"sink\":\""); b.append(o.sink);
+        b.append("\",\"msg\":\""); b.append(o.msg);
+        b.append("\",\"count\":"); b.append_int(n);
+        b.append(",\"caller_msgs_per_sec\":"); b.append_int((long long)((double)n / caller_s));
+        b.append(",\"msgs_per_sec\":"); b.append_int((long long)((double)n / total_s));
+        b.append(",\"p50_ns\":"); b.append_int(pct(all, 0.50));
+        b.append(",\"p99_ns\":"); b.append_int(pct(all, 0.99));
+        b.append(",\"p999_ns\":"); b.append_int(pct(all, 0.999));
+        b.append(",\"max_ns\":"); b.append_int(all.empty() ? 0 : (uint64_t)all.back());
+#if TINYLOG_ASYNC
+        b.append(",\"dropped\":"); b.append_int(L.dropped_count());
+#endif
+        b.append("}\n");
+        tinylog::file_write_all(results_fd, b.data(), b.size());
+        return 0;
+    }
+
+    // Every case, each in a child process running this same binary.
+    int run_all(const char* self, const Options& o) {
+        int rc = 0;
+        for (int threads : { 1, 4, 16, 64 })
+            for (const char* sink : { "null", "file", "console" })
+                for (const char* msg : { "short", "long" }) {
+                    std::cout.flush();
+                    std::string cmd = std::string("\"") + self + "\" --threads " + std::to_string(threads) +
+                                      " --sink " + sink + " --msg " + msg + " --count " + std::to_string(o.count) +
+                                      " --dir \"" + o.dir + "\"";
+                    if (std::system(cmd.c_str()) != 0) { std::cerr << "case failed: " << cmd << "\n"; rc = 1; }
+                }
+        std::error_code ec; fs::remove_all(o.dir, ec);
+        return rc;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    bool single = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : std::string(); };
+        if (a == "--threads") { o.threads = std::max(1, std::atoi(next().c_str())); single = true; }
+        else if (a == "--sink") { o.sink = next(); single = true; }
+        else if (a == "--msg") { o.msg = next(); single = true; }
+        else if (a == "--count") o.count = std::max(1L, std::atol(next().c_str()));
+        else if (a == "--dir") o.dir = next();
+        else {
+            std::cerr << "usage: " << argv[0] << " [--threads N] [--sink null|file|console] [--msg short|long] [--count N] [--dir DIR]\n";
+            return 2;
+        }
+    }
+    return single ? run_case(o) : run_all(argv[0], o);
+}
@@ -0,0 +1,20 @@
+// tinylog-decode: turns BinaryFileSink output back into text lines.
+//   g++ -std=c++17 -O2 -I. Tools/Decode/main.cpp -o tinylog-decode
+//   ./tinylog-decode logs/app.bin [logs/app.bin.1 ...] > app.log
+#include "TinyLog/tinylog.hpp"
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " FILE...\n";
+        return 2;
+    }
+    int rc = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream in(argv[i], std::ios::binary);
+        if (!in) { std::cerr << argv[i] << ": cannot open\n"; rc = 1; continue; }
+        if (!tinylog::decode_binary_log(in, std::cout)) { std::cerr << argv[i] << ": not a valid TinyLog binary file\n"; rc = 1; }
+    }
+    return rc;
+}